@@ -52,16 +52,22 @@
   */
 #define UTIL_WEIGHT .60
 
-/* 
- * Alignment requirement in bytes (either 4 or 8) 
+/*
+ * Payload alignment: 8, or 16 for the x86-64 max_align_t. The Makefile
+ * passes -DALIGNMENT so that mm.c and the driver always agree.
  */
+#ifndef ALIGNMENT
 #define ALIGNMENT 8  
+#endif
 
 /* 
  * Maximum heap size in bytes 
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
+/* Cache line size used by mdriver -c to report straddling payloads */
+#define CACHE_LINE 64
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
@@ -13,15 +13,23 @@
 #include <errno.h>
 #include <string.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <float.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 extern char *optarg; // Added declaration for optarg
 
 #include "mm.h"
+#include "mm_inline.h"
 #include "memlib.h"
 #include "fsecs.h"
 #include "config.h"
+#include "tracebin.h"
 
 /**********************
  * Constants and macros
@@ -32,44 +40,59 @@ extern char *optarg; // Added declaration for optarg
 #define HDRLINES 4		   /* number of header lines in a trace file */
 #define LINENUM(i) (i + 5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Binary traces are prefaulted when mapped where the system allows it */
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p) ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p) ((((uintptr_t)(p)) % ALIGNMENT) == 0)
+
+/* Multithreaded replay (-T) */
+#define MAX_THREADS 256 /* largest thread count accepted by -T */
+#define THREAD_REPS 5	/* timed replays per thread count (the best counts) */
+#define SPIN_YIELD 64	/* polls before a waiting thread gives up its CPU */
+
+/* Thread that runs trace request op in the shared mode of -T */
+#define OWNER(op, n) ((((op)->type == FREE) ? (op)->index + 1 : (op)->index) % (n))
 
 /******************************
  * The key compound data types
  *****************************/
 
-/* Records the extent of each block's payload */
+/*
+ * Records the extent of each block's payload. The records form a treap
+ * ordered by lo (a binary search tree that is also a heap on prio), so
+ * that adding, checking and removing a block take O(log n) expected
+ * time in the number of live blocks.
+ */
 typedef struct range_t
 {
-	char *lo;			  /* low payload address */
-	char *hi;			  /* high payload address */
-	struct range_t *next; /* next list element */
+	char *lo;			   /* low payload address */
+	char *hi;			   /* high payload address */
+	unsigned int prio;	   /* random heap priority (larger nearer the root) */
+	struct range_t *left;  /* ranges with lower addresses */
+	struct range_t *right; /* ranges with higher addresses */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct
-{
-	enum
-	{
-		ALLOC,
-		FREE,
-		REALLOC
-	} type;	   /* type of request */
-	int index; /* index for free() to use later */
-	int size;  /* byte size of alloc/realloc request */
-} traceop_t;
+/*
+ * A single trace operation (allocator request) is a traceop_t, the
+ * fixed-width record of the binary trace format in tracebin.h, so that
+ * binary traces can be replayed straight from the file mapping.
+ */
 
 /* Holds the information for one trace file*/
 typedef struct
 {
-	int sugg_heapsize;	 /* suggested heap size (unused) */
+	size_t sugg_heapsize; /* suggested heap size (reserved with -S) */
 	int num_ids;		 /* number of alloc/realloc ids */
 	int num_ops;		 /* number of distinct requests */
 	int weight;			 /* weight for this trace (unused) */
 	traceop_t *ops;		 /* array of requests */
 	char **blocks;		 /* array of ptrs returned by malloc/realloc... */
 	size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+	void *map;			 /* mapping of a binary trace holding ops, or NULL */
+	size_t map_size;	 /* length of the mapping */
 } trace_t;
 
 /*
@@ -83,6 +106,29 @@ typedef struct
 	range_t *ranges;
 } speed_t;
 
+/*
+ * Holds the params of one replay thread for -T. In the private mode
+ * every thread replays the whole trace on its own heap and its own copy
+ * of the block arrays; in the shared mode the threads split the trace
+ * by id and pass blocks to each other, in trace order, through done[].
+ */
+typedef struct
+{
+	trace_t *trace;
+	int tracenum;
+	int self;				  /* thread number */
+	mm_heap_t *heap;		  /* private mode: this thread's heap (NULL: default heap) */
+	int *ops;				  /* numbers of the requests this thread runs */
+	int num_ops;			  /* ... and how many there are */
+	int check;				  /* if set, validate every request (untimed pass) */
+	char **blocks;			  /* block pointers by id (shared in shared mode) */
+	size_t *block_sizes;	  /* ... and payload sizes */
+	int *seq;				  /* shared mode: earlier requests on the id of each op */
+	int *done;				  /* shared mode: requests completed on each id */
+	pthread_barrier_t *start; /* all threads start together */
+	struct timespec t0;		  /* when this thread passed start */
+} replay_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct
 {
@@ -94,6 +140,11 @@ typedef struct
 	/* defined only for the student malloc package */
 	double util; /* space utilization for this trace (always 0 for libc) */
 
+	/* cache-line stats, defined only for mm and only with -c */
+	double small;	   /* number of alloc/realloc requests <= CACHE_LINE bytes */
+	double straddle;   /* ... whose payload crosses a CACHE_LINE boundary */
+	double touch_secs; /* secs for a replay that writes and reads payloads */
+
 	/* Note: secs and util are only defined if valid is true */
 } stats_t;
 
@@ -102,6 +153,10 @@ typedef struct
  *******************/
 int verbose = 0;	   /* global flag for verbose output */
 static int errors = 0; /* number of errs found when running student malloc */
+static int sugg_reserve = 0; /* reserve sugg_heapsize at mm_init (set by -S) */
+static int quick = 0; /* replay through the mm_inline.h fast path (set by -q) */
+static int replay_failed = 0; /* set by a -T thread that found an error */
+static pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER; /* -T error output */
 char msg[MAXLINE];	   /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
@@ -115,15 +170,20 @@ static char *default_tracefiles[] = {
  * Function prototypes
  *********************/
 
-/* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size,
+/* these functions manipulate range trees */
+static int add_range(range_t **ranges, char *lo, size_t size,
 					 int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static range_t *insert_range(range_t *root, range_t *p);
+static range_t *delete_range(range_t *root, char *lo);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static trace_t *map_trace(trace_t *trace, char *path);
+static void bad_trace(char *path, char *what);
 static void free_trace(trace_t *trace);
+static void hint_lifetimes(trace_t *trace, int short_ops);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
@@ -134,11 +194,28 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_lines(trace_t *trace, stats_t *stats);
+static void eval_mm_touch(void *ptr);
+static int init_mm(trace_t *trace);
+static void *mm_alloc_op(size_t size, int hint);
+static void mm_free_op(void *ptr);
+
+/* Routines for replaying a trace on several threads at once (-T) */
+static void eval_mm_threads(trace_t *trace, int tracenum, int nthreads,
+							int shared, size_t heap_limit, stats_t *stats);
+static void *replay_thread(void *ptr);
+static int replay_check(replay_t *r, int opnum, char *p, size_t size,
+						size_t keep, unsigned char fill);
+static void replay_error(replay_t *r, int opnum, char *msg);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printlines(int n, stats_t *stats);
+static void printthreads(int n, int ncounts, int *counts, stats_t *stats);
 static void usage(void);
 static void unix_error(char *msg);
+static size_t parse_size(char *str);
+static size_t engine_heap(int engine, size_t heap_limit);
 static void malloc_error(int tracenum, int opnum, char *msg);
 static void app_error(char *msg);
 
@@ -155,20 +232,33 @@ int main(int argc, char **argv)
 	range_t *ranges = NULL;		/* keeps track of block extents for one trace */
 	stats_t *libc_stats = NULL; /* libc stats for each trace */
 	stats_t *mm_stats = NULL;	/* mm (i.e. student) stats for each trace */
+	stats_t *buddy_stats = NULL; /* mm stats with the buddy engine */
 	speed_t speed_params;		/* input parameters to the xx_speed routines */
 
 	int team_check = 1; /* If set, check team structure (reset by -a) */
 	int run_libc = 0;	/* If set, run libc malloc (set by -l) */
+	int run_buddy = 0;	/* If set, run the buddy engine too (set by -b) */
 	int autograder = 0; /* If set, emit summary info for autograder (-g) */
+	int line_stats = 0; /* If set, measure cache-line placement (-c) */
+	size_t heap_limit = MAX_HEAP; /* simulated heap limit (set by -H) */
+	int short_ops = 0;	/* If set, derive lifetime hints from the trace (-L) */
+	size_t copy_threshold;	/* streaming copy threshold for realloc (-N) */
+	int max_threads = 0;	/* If set, replay on up to this many threads (-T) */
+	mm_config_t mm_conf;	/* allocator settings (defaults and MM_CONF) */
 
 	/* temporaries used to compute the performance index */
 	double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
 	int numcorrect;
 
+	/* MM_CONF may set the heap limit; -H still overrides it */
+	mm_get_config(&mm_conf);
+	if (mm_conf.max_heap != 0)
+		heap_limit = mm_conf.max_heap;
+
 	/*
 	 * Read and interpret the command line arguments
 	 */
-	while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF)
+	while ((c = getopt(argc, argv, "f:t:H:L:N:T:hvVgalcbqS")) != EOF)
 	{
 		printf("getopt returned: %d\n", c); // 디버깅용 출력 추가
 
@@ -192,12 +282,58 @@ int main(int argc, char **argv)
 			if (tracedir[strlen(tracedir) - 1] != '/')
 				strcat(tracedir, "/"); /* path always ends with "/" */
 			break;
+		case 'H': /* Heap limit, e.g. 64M or 8G */
+			if ((heap_limit = parse_size(optarg)) == 0)
+			{
+				usage();
+				exit(1);
+			}
+			break;
+		case 'L': /* Hint blocks freed within this many ops as short-lived */
+			if ((short_ops = atoi(optarg)) <= 0)
+			{
+				usage();
+				exit(1);
+			}
+			break;
+		case 'N': /* Non-temporal copy threshold for realloc moves */
+			if (strcmp(optarg, "0") == 0)
+				mm_set_copy_threshold(0);
+			else if ((copy_threshold = parse_size(optarg)) == 0)
+			{
+				usage();
+				exit(1);
+			}
+			else
+				mm_set_copy_threshold(copy_threshold);
+			break;
+		case 'T': /* Replay on 1, 2, 4, ... this many threads at once */
+			if ((max_threads = atoi(optarg)) <= 0 || max_threads > MAX_THREADS)
+			{
+				usage();
+				exit(1);
+			}
+			break;
 		case 'a': /* Don't check team structure */
 			team_check = 0;
 			break;
 		case 'l': /* Run libc malloc */
 			run_libc = 1;
 			break;
+		case 'b': /* Compare with the buddy engine (prints both tables) */
+			run_buddy = 1;
+			if (verbose == 0)
+				verbose = 1;
+			break;
+		case 'q': /* Replay allocs and frees through the inline fast path */
+			quick = 1;
+			break;
+		case 'S': /* Reserve each trace's suggested heap size up front */
+			sugg_reserve = 1;
+			break;
+		case 'c': /* Measure cache-line straddling and payload touching */
+			line_stats = 1;
+			break;
 		case 'v': /* Print per-trace performance breakdown */
 			verbose = 1;
 			break;
@@ -309,12 +445,14 @@ int main(int argc, char **argv)
 		unix_error("mm_stats calloc in main failed");
 
 	/* Initialize the simulated memory system in memlib.c */
-	mem_init();
+	mem_init_size(engine_heap(mm_conf.engine, heap_limit));
 
 	/* Evaluate student's mm malloc package using the K-best scheme */
 	for (i = 0; i < num_tracefiles; i++)
 	{
 		trace = read_trace(tracedir, tracefiles[i]);
+		if (short_ops)
+			hint_lifetimes(trace, short_ops);
 		mm_stats[i].ops = trace->num_ops;
 		if (verbose > 1)
 			printf("Checking mm_malloc for correctness, ");
@@ -329,6 +467,11 @@ int main(int argc, char **argv)
 			if (verbose > 1)
 				printf("and performance.\n");
 			mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+			if (line_stats)
+			{
+				eval_mm_lines(trace, &mm_stats[i]);
+				mm_stats[i].touch_secs = fsecs(eval_mm_touch, &speed_params);
+			}
 		}
 		free_trace(trace);
 	}
@@ -336,10 +479,108 @@ int main(int argc, char **argv)
 	/* Display the mm results in a compact table */
 	if (verbose)
 	{
-		printf("\nResults for mm malloc:\n");
+		printf(quick ? "\nResults for mm malloc (inline fast path):\n"
+					 : "\nResults for mm malloc:\n");
 		printresults(num_tracefiles, mm_stats);
 		printf("\n");
 	}
+	if (line_stats)
+	{
+		printf("Cache-line results for mm malloc (%d-byte lines):\n", CACHE_LINE);
+		printlines(num_tracefiles, mm_stats);
+		printf("\n");
+	}
+
+	/*
+	 * Optionally run the same traces on the buddy engine for comparison,
+	 * on a simulated heap of its own size (engine_heap). The performance
+	 * index below is still computed for the default engine.
+	 */
+	if (run_buddy)
+	{
+		int engine = mm_set_engine(MM_ENGINE_BUDDY);
+		int saved_errors = errors; /* buddy failures don't void the index */
+
+		mem_deinit();
+		mem_init_size(engine_heap(MM_ENGINE_BUDDY, heap_limit));
+
+		if (verbose > 1)
+			printf("Testing mm malloc with the buddy engine\n");
+		buddy_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+		if (buddy_stats == NULL)
+			unix_error("buddy_stats calloc in main failed");
+
+		for (i = 0; i < num_tracefiles; i++)
+		{
+			trace = read_trace(tracedir, tracefiles[i]);
+			buddy_stats[i].ops = trace->num_ops;
+			if (verbose > 1)
+				printf("Checking buddy engine for correctness, ");
+			buddy_stats[i].valid = eval_mm_valid(trace, i, &ranges);
+			if (buddy_stats[i].valid)
+			{
+				if (verbose > 1)
+					printf("efficiency, and performance.\n");
+				buddy_stats[i].util = eval_mm_util(trace, i, &ranges);
+				speed_params.trace = trace;
+				speed_params.ranges = ranges;
+				buddy_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+			}
+			free_trace(trace);
+		}
+		mm_set_engine(engine);
+		mem_deinit();
+		mem_init_size(engine_heap(engine, heap_limit));
+
+		printf("Results for mm malloc (buddy engine):\n");
+		printresults(num_tracefiles, buddy_stats);
+		printf("\n");
+		errors = saved_errors;
+	}
+
+	/*
+	 * Optionally replay the traces on 1, 2, 4, ... max_threads threads:
+	 * first one private copy of each trace per thread, each on a heap of
+	 * its own, then each trace split across the threads on the default
+	 * heap with its lock on.
+	 */
+	mm_get_config(&mm_conf);
+	if (max_threads > 0)
+	{
+		int counts[16]; /* thread counts to run */
+		int ncounts = 0;
+		int shared, j, k;
+		stats_t *thread_stats;
+
+		for (k = 1; k < max_threads; k *= 2)
+			counts[ncounts++] = k;
+		counts[ncounts++] = max_threads;
+
+		thread_stats = (stats_t *)calloc(num_tracefiles * ncounts, sizeof(stats_t));
+		if (thread_stats == NULL)
+			unix_error("thread_stats calloc in main failed");
+		for (shared = 0; shared <= 1; shared++)
+		{
+			if (verbose > 1)
+				printf("Replaying the traces on up to %d threads\n", max_threads);
+			for (i = 0; i < num_tracefiles; i++)
+			{
+				trace = read_trace(tracedir, tracefiles[i]);
+				if (short_ops)
+					hint_lifetimes(trace, short_ops);
+				for (j = 0; j < ncounts; j++)
+					eval_mm_threads(trace, i, counts[j], shared,
+									engine_heap(mm_conf.engine, heap_limit),
+									&thread_stats[i * ncounts + j]);
+				free_trace(trace);
+			}
+			printf(shared ? "Results for mm malloc, each trace split across the threads:\n"
+						  : "Results for mm malloc, one copy of each trace per thread:\n");
+			printthreads(num_tracefiles, ncounts, counts, thread_stats);
+			printf("\n");
+		}
+		free(thread_stats);
+	}
 
 	/*
 	 * Accumulate the aggregate statistics for the student's mm package
@@ -398,9 +639,9 @@ int main(int argc, char **argv)
 }
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps
+ * The following routines manipulate the range tree, which keeps
  * track of the extent of every allocated block payload. We use the
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks.
  ****************************************************************/
 
 /*
@@ -409,12 +650,13 @@ int main(int argc, char **argv)
  *     size bytes at addr lo. After checking the block for correctness,
  *     we create a range struct for this block and add it to the range list.
  */
-static int add_range(range_t **ranges, char *lo, int size,
+static int add_range(range_t **ranges, char *lo, size_t size,
 					 int tracenum, int opnum)
 {
 	char *hi = lo + size - 1;
-	range_t *p;
+	range_t *p, *q;
 	char msg[MAXLINE];
+	static unsigned int seed = 1;
 
 	assert(size > 0);
 
@@ -427,9 +669,8 @@ static int add_range(range_t **ranges, char *lo, int size,
 		return 0;
 	}
 
-	/* The payload must lie within the extent of the heap */
-	if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-		(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi()))
+	/* The payload must lie within the extent of the heap (or a segment) */
+	if (!mem_heap_contains(lo, hi))
 	{
 		sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 				lo, hi, mem_heap_lo(), mem_heap_hi());
@@ -437,52 +678,128 @@ static int add_range(range_t **ranges, char *lo, int size,
 		return 0;
 	}
 
-	/* The payload must not overlap any other payloads */
-	for (p = *ranges; p != NULL; p = p->next)
+	/*
+	 * The payload must not overlap any other payloads. The ranges in
+	 * the tree don't overlap each other, so only the one that starts
+	 * last at or below hi can reach into [lo, hi].
+	 */
+	for (p = *ranges, q = NULL; p != NULL;)
 	{
-		if ((lo >= p->lo && lo <= p->hi) ||
-			(hi >= p->lo && hi <= p->hi))
+		if (p->lo <= hi)
 		{
-			sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-					lo, hi, p->lo, p->hi);
-			malloc_error(tracenum, opnum, msg);
-			return 0;
+			q = p;
+			p = p->right;
 		}
+		else
+			p = p->left;
+	}
+	if (q != NULL && q->hi >= lo)
+	{
+		sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+				lo, hi, q->lo, q->hi);
+		malloc_error(tracenum, opnum, msg);
+		return 0;
 	}
 
 	/*
 	 * Everything looks OK, so remember the extent of this block
-	 * by creating a range struct and adding it the range list.
+	 * by creating a range struct and adding it the range tree.
 	 */
 	if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
 		unix_error("malloc error in add_range");
-	p->next = *ranges;
+	seed = seed * 1103515245 + 12345; /* any spread of priorities will do */
 	p->lo = lo;
 	p->hi = hi;
-	*ranges = p;
+	p->prio = seed >> 8;
+	p->left = p->right = NULL;
+	*ranges = insert_range(*ranges, p);
 	return 1;
 }
 
+/*
+ * insert_range - Insert p into the tree rooted at root and return the
+ *     new root. p goes in as a leaf and is rotated up while its
+ *     priority is higher than its parent's.
+ */
+static range_t *insert_range(range_t *root, range_t *p)
+{
+	range_t *q;
+
+	if (root == NULL)
+		return p;
+	if (p->lo < root->lo)
+	{
+		root->left = insert_range(root->left, p);
+		if (root->left->prio > root->prio)
+		{ /* rotate right */
+			q = root->left;
+			root->left = q->right;
+			q->right = root;
+			return q;
+		}
+	}
+	else
+	{
+		root->right = insert_range(root->right, p);
+		if (root->right->prio > root->prio)
+		{ /* rotate left */
+			q = root->right;
+			root->right = q->left;
+			q->left = root;
+			return q;
+		}
+	}
+	return root;
+}
+
 /*
  * remove_range - Free the range record of block whose payload starts at lo
  */
 static void remove_range(range_t **ranges, char *lo)
 {
-	range_t *p;
-	range_t **prevpp = ranges;
-	int size;
+	*ranges = delete_range(*ranges, lo);
+}
 
-	for (p = *ranges; p != NULL; p = p->next)
+/*
+ * delete_range - Remove the record starting at lo (if any) from the tree
+ *     rooted at root, free it, and return the new root. Its two subtrees
+ *     are merged in priority order.
+ */
+static range_t *delete_range(range_t *root, char *lo)
+{
+	range_t *p = root;
+	range_t **pp = &root;
+	range_t *l, *r;
+
+	while (p != NULL && p->lo != lo)
+	{
+		pp = (lo < p->lo) ? &p->left : &p->right;
+		p = *pp;
+	}
+	if (p == NULL)
+		return root;
+
+	/* Merge the subtrees: the right spine of l meets the left spine of r */
+	l = p->left;
+	r = p->right;
+	free(p);
+	while (l != NULL && r != NULL)
 	{
-		if (p->lo == lo)
+		if (l->prio > r->prio)
 		{
-			*prevpp = p->next;
-			size = p->hi - p->lo + 1;
-			free(p);
-			break;
+			*pp = l;
+			pp = &l->right;
+			l = l->right;
+		}
+		else
+		{
+			*pp = r;
+			pp = &r->left;
+			r = r->left;
 		}
-		prevpp = &(p->next);
 	}
+	*pp = (l != NULL) ? l : r;
+	return root;
 }
 
 /*
@@ -490,13 +807,25 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-	range_t *p;
-	range_t *pnext;
+	range_t *p = *ranges;
+	range_t *q;
 
-	for (p = *ranges; p != NULL; p = pnext)
+	/* Rotate left children up so the tree becomes a right-going list */
+	while (p != NULL)
 	{
-		pnext = p->next;
-		free(p);
+		if (p->left != NULL)
+		{
+			q = p->left;
+			p->left = q->right;
+			q->right = p;
+			p = q;
+		}
+		else
+		{
+			q = p->right;
+			free(p);
+			p = q;
+		}
 	}
 	*ranges = NULL;
 }
@@ -514,7 +843,9 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	trace_t *trace;
 	char type[MAXLINE];
 	char path[MAXLINE];
-	unsigned index, size;
+	char magic[sizeof(TRACE_MAGIC)];
+	unsigned index;
+	unsigned long size;
 	unsigned max_index = 0;
 	unsigned op_index;
 
@@ -533,7 +864,19 @@ static trace_t *read_trace(char *tracedir, char *filename)
 		sprintf(msg, "Could not open %s in read_trace", path);
 		unix_error(msg);
 	}
-	fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
+
+	/* A binary trace (see tracebin.h) is mapped instead of parsed */
+	if (fread(magic, 1, sizeof(magic), tracefile) == sizeof(magic) &&
+		memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0)
+	{
+		fclose(tracefile);
+		return map_trace(trace, path);
+	}
+	rewind(tracefile);
+	trace->map = NULL;
+	trace->map_size = 0;
+
+	fscanf(tracefile, "%zu", &(trace->sugg_heapsize)); /* used by -S */
 	fscanf(tracefile, "%d", &(trace->num_ids));
 	fscanf(tracefile, "%d", &(trace->num_ops));
 	fscanf(tracefile, "%d", &(trace->weight)); /* not used */
@@ -561,23 +904,30 @@ static trace_t *read_trace(char *tracedir, char *filename)
 		switch (type[0])
 		{
 		case 'a':
-			fscanf(tracefile, "%u %u", &index, &size);
+		case 's': /* alloc with MM_SHORT_LIVED hint */
+		case 'l': /* alloc with MM_LONG_LIVED hint */
+			fscanf(tracefile, "%u %lu", &index, &size);
 			trace->ops[op_index].type = ALLOC;
 			trace->ops[op_index].index = index;
 			trace->ops[op_index].size = size;
+			trace->ops[op_index].hint = (type[0] == 's')   ? MM_SHORT_LIVED
+										: (type[0] == 'l') ? MM_LONG_LIVED
+														   : 0;
 			max_index = (index > max_index) ? index : max_index;
 			break;
 		case 'r':
-			fscanf(tracefile, "%u %u", &index, &size);
+			fscanf(tracefile, "%u %lu", &index, &size);
 			trace->ops[op_index].type = REALLOC;
 			trace->ops[op_index].index = index;
 			trace->ops[op_index].size = size;
+			trace->ops[op_index].hint = 0;
 			max_index = (index > max_index) ? index : max_index;
 			break;
 		case 'f':
 			fscanf(tracefile, "%ud", &index);
 			trace->ops[op_index].type = FREE;
 			trace->ops[op_index].index = index;
+			trace->ops[op_index].hint = 0;
 			break;
 		default:
 			printf("Bogus type character (%c) in tracefile %s\n",
@@ -593,13 +943,117 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	return trace;
 }
 
+/*
+ * map_trace - Map the binary trace at path (written by rep2bin) and
+ *     point trace->ops at its records, which are replayed in place. The
+ *     mapping is private, so hint_lifetimes may rewrite hints without
+ *     touching the file. The header, the checksum and every request's
+ *     type and id are checked before the trace is used.
+ */
+static trace_t *map_trace(trace_t *trace, char *path)
+{
+	const trace_hdr_t *hdr;
+	traceop_t *ops;
+	struct stat st;
+	char *map;
+	uint32_t i;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+	{
+		sprintf(msg, "Could not open %s in read_trace", path);
+		unix_error(msg);
+	}
+	if ((size_t)st.st_size < sizeof(trace_hdr_t))
+		bad_trace(path, "truncated header");
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	if (map == MAP_FAILED)
+		unix_error("mmap failed in map_trace");
+	close(fd);
+
+	hdr = (const trace_hdr_t *)map;
+	if (hdr->byte_order != TRACE_BYTE_ORDER)
+		bad_trace(path, "written with the other byte order (rerun rep2bin)");
+	if (hdr->version != TRACE_VERSION || hdr->op_size != sizeof(traceop_t))
+		bad_trace(path, "unsupported format version");
+	if (hdr->num_ids == 0 || hdr->num_ids > INT_MAX || hdr->num_ops > INT_MAX ||
+		(uint64_t)st.st_size !=
+			sizeof(trace_hdr_t) + (uint64_t)hdr->num_ops * sizeof(traceop_t))
+		bad_trace(path, "file size does not match the header");
+	ops = (traceop_t *)(map + sizeof(trace_hdr_t));
+	if (trace_checksum(ops, hdr->num_ops) != hdr->checksum)
+		bad_trace(path, "checksum mismatch");
+	for (i = 0; i < hdr->num_ops; i++)
+		if (ops[i].type > REALLOC || ops[i].index >= hdr->num_ids)
+			bad_trace(path, "bad request type or id");
+
+	trace->sugg_heapsize = hdr->sugg_heapsize;
+	trace->num_ids = hdr->num_ids;
+	trace->num_ops = hdr->num_ops;
+	trace->weight = hdr->weight;
+	trace->ops = ops;
+	trace->map = map;
+	trace->map_size = st.st_size;
+
+	if ((trace->blocks =
+			 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+		unix_error("malloc 3 failed in map_trace");
+	if ((trace->block_sizes =
+			 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+		unix_error("malloc 4 failed in map_trace");
+
+	return trace;
+}
+
+/*
+ * bad_trace - Report a binary trace that cannot be used
+ */
+static void bad_trace(char *path, char *what)
+{
+	sprintf(msg, "Bad binary trace %s: %s", path, what);
+	app_error(msg);
+}
+
+/*
+ * hint_lifetimes - Attach lifetime hints to every alloc request, using
+ *     the trace itself as an oracle: a block that is freed within
+ *     short_ops requests of its allocation is MM_SHORT_LIVED, any other
+ *     block (including one that is never freed) is MM_LONG_LIVED.
+ *     Hints already present in the trace file are replaced.
+ */
+static void hint_lifetimes(trace_t *trace, int short_ops)
+{
+	int i;
+	int *born; /* op number of the alloc that created each live id */
+
+	if ((born = (int *)malloc(trace->num_ids * sizeof(int))) == NULL)
+		unix_error("malloc failed in hint_lifetimes");
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		traceop_t *op = &trace->ops[i];
+		if (op->type == ALLOC)
+		{
+			born[op->index] = i;
+			op->hint = MM_LONG_LIVED; /* until we see it freed */
+		}
+		else if (op->type == FREE && i - born[op->index] <= short_ops)
+			trace->ops[born[op->index]].hint = MM_SHORT_LIVED;
+	}
+	free(born);
+}
+
 /*
  * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ *              to, all of which were allocated in read_trace(). The
+ *              ops of a binary trace live in its mapping instead.
  */
 void free_trace(trace_t *trace)
 {
-	free(trace->ops); /* free the three arrays... */
+	if (trace->map != NULL)
+		munmap(trace->map, trace->map_size);
+	else
+		free(trace->ops); /* free the three arrays... */
 	free(trace->blocks);
 	free(trace->block_sizes);
 	free(trace); /* and the trace record itself... */
@@ -610,15 +1064,52 @@ void free_trace(trace_t *trace)
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * init_mm - initialize the mm package for a trace, reserving the
+ *     trace's suggested heap size up front if -S was given
+ */
+static int init_mm(trace_t *trace)
+{
+	mm_config_t conf;
+
+	if (!sugg_reserve)
+		return mm_init();
+	mm_get_config(&conf);
+	conf.reserve = trace->sugg_heapsize;
+	return mm_init_ex(&conf);
+}
+
+/*
+ * mm_alloc_op, mm_free_op - Run an alloc or free request on the default
+ *     heap. With -q they go through mm_malloc_inline and mm_free_inline;
+ *     hinted allocs still go to mm_malloc_hint, which the fast path
+ *     does not take.
+ */
+static void *mm_alloc_op(size_t size, int hint)
+{
+	if (quick && hint == 0)
+		return mm_malloc_inline(size);
+	return mm_malloc_hint(size, hint);
+}
+
+static void mm_free_op(void *ptr)
+{
+	if (quick)
+		mm_free_inline(ptr);
+	else
+		mm_free(ptr);
+}
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 {
-	int i, j;
+	int i;
+	size_t j;
 	int index;
-	int size;
-	int oldsize;
+	size_t size;
+	size_t oldsize;
 	char *newp;
 	char *oldp;
 	char *p;
@@ -628,7 +1119,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	clear_ranges(ranges);
 
 	/* Call the mm package's init function */
-	if (mm_init() < 0)
+	if (init_mm(trace) < 0)
 	{
 		malloc_error(tracenum, 0, "mm_init failed.");
 		return 0;
@@ -646,7 +1137,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 		case ALLOC: /* mm_malloc */
 
 			/* Call the student's malloc */
-			if ((p = mm_malloc(size)) == NULL)
+			if ((p = mm_alloc_op(size, trace->ops[i].hint)) == NULL)
 			{
 				malloc_error(tracenum, i, "mm_malloc failed.");
 				return 0;
@@ -699,7 +1190,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 				oldsize = size;
 			for (j = 0; j < oldsize; j++)
 			{
-				if (newp[j] != (index & 0xFF))
+				if ((unsigned char)newp[j] != (index & 0xFF))
 				{
 					malloc_error(tracenum, i, "mm_realloc did not preserve the "
 											  "data from old block");
@@ -718,7 +1209,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 			/* Remove region from list and call student's free function */
 			p = trace->blocks[index];
 			remove_range(ranges, p);
-			mm_free(p);
+			mm_free_op(p);
 			break;
 
 		default:
@@ -745,15 +1236,15 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 {
 	int i;
 	int index;
-	int size, newsize, oldsize;
-	int max_total_size = 0;
-	int total_size = 0;
+	size_t size, newsize, oldsize;
+	size_t max_total_size = 0;
+	size_t total_size = 0;
 	char *p;
 	char *newp, *oldp;
 
 	/* initialize the heap and the mm malloc package */
 	mem_reset_brk();
-	if (mm_init() < 0)
+	if (init_mm(trace) < 0)
 		app_error("mm_init failed in eval_mm_util");
 
 	for (i = 0; i < trace->num_ops; i++)
@@ -765,7 +1256,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 			index = trace->ops[i].index;
 			size = trace->ops[i].size;
 
-			if ((p = mm_malloc(size)) == NULL)
+			if ((p = mm_alloc_op(size, trace->ops[i].hint)) == NULL)
 				app_error("mm_malloc failed in eval_mm_util");
 
 			/* Remember region and size */
@@ -806,7 +1297,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 			size = trace->block_sizes[index];
 			p = trace->blocks[index];
 
-			mm_free(p);
+			mm_free_op(p);
 
 			/* Keep track of current total size
 			 * of all allocated blocks */
@@ -819,7 +1310,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 		}
 	}
 
-	return ((double)max_total_size / (double)mem_heapsize());
+	return ((double)max_total_size / (double)mem_heap_peak());
 }
 
 /*
@@ -828,13 +1319,14 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-	int i, index, size, newsize;
+	int i, index;
+	size_t size, newsize;
 	char *p, *newp, *oldp, *block;
 	trace_t *trace = ((speed_t *)ptr)->trace;
 
 	/* Reset the heap and initialize the mm package */
 	mem_reset_brk();
-	if (mm_init() < 0)
+	if (init_mm(trace) < 0)
 		app_error("mm_init failed in eval_mm_speed");
 
 	/* Interpret each trace request */
@@ -845,7 +1337,7 @@ static void eval_mm_speed(void *ptr)
 		case ALLOC: /* mm_malloc */
 			index = trace->ops[i].index;
 			size = trace->ops[i].size;
-			if ((p = mm_malloc(size)) == NULL)
+			if ((p = mm_alloc_op(size, trace->ops[i].hint)) == NULL)
 				app_error("mm_malloc error in eval_mm_speed");
 			trace->blocks[index] = p;
 			break;
@@ -862,7 +1354,7 @@ static void eval_mm_speed(void *ptr)
 		case FREE: /* mm_free */
 			index = trace->ops[i].index;
 			block = trace->blocks[index];
-			mm_free(block);
+			mm_free_op(block);
 			break;
 
 		default:
@@ -870,6 +1362,434 @@ static void eval_mm_speed(void *ptr)
 		}
 }
 
+/*
+ * eval_mm_threads - Replay a trace on nthreads threads at once. In the
+ *     private mode (shared == 0) each thread replays the whole trace on
+ *     a heap of its own (mm_heap_create with heap_limit bytes, emptied
+ *     with mm_heap_reset before each pass), so no lock is taken. In the shared mode the threads use the default heap
+ *     with its lock on (mm_set_locking); the alloc and realloc requests
+ *     for id i go to thread i % nthreads and the free to thread
+ *     (i + 1) % nthreads, so blocks are freed by another thread than the
+ *     one that allocated them, and a thread waits until the earlier
+ *     requests on an id are done before it runs its own. A first pass
+ *     validates every request in the thread that made it, then the best
+ *     of THREAD_REPS timed passes gives stats->secs.
+ */
+static void eval_mm_threads(trace_t *trace, int tracenum, int nthreads,
+							int shared, size_t heap_limit, stats_t *stats)
+{
+	replay_t *r;
+	pthread_t *tids;
+	pthread_barrier_t start;
+	struct timespec t0, t1;
+	int *ops;
+	int *seq = NULL;
+	int *done = NULL;
+	int i, t, pass, pos, ret;
+	double secs;
+
+	r = (replay_t *)calloc(nthreads, sizeof(replay_t));
+	tids = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+	ops = (int *)malloc(trace->num_ops * sizeof(int));
+	if (r == NULL || tids == NULL || ops == NULL)
+		unix_error("malloc failed in eval_mm_threads");
+
+	if (shared)
+	{
+		/* seq[i] counts the requests on the same id before request i */
+		seq = (int *)malloc(trace->num_ops * sizeof(int));
+		done = (int *)calloc(trace->num_ids, sizeof(int));
+		if (seq == NULL || done == NULL)
+			unix_error("malloc failed in eval_mm_threads");
+		for (i = 0; i < trace->num_ops; i++)
+		{
+			seq[i] = done[trace->ops[i].index]++;
+			r[OWNER(&trace->ops[i], nthreads)].num_ops++;
+		}
+		/* Give each thread its requests, in trace order */
+		for (t = 0, pos = 0; t < nthreads; t++)
+		{
+			r[t].ops = ops + pos;
+			pos += r[t].num_ops;
+			r[t].num_ops = 0;
+		}
+		for (i = 0; i < trace->num_ops; i++)
+		{
+			t = OWNER(&trace->ops[i], nthreads);
+			r[t].ops[r[t].num_ops++] = i;
+		}
+	}
+	else
+	{
+		for (i = 0; i < trace->num_ops; i++)
+			ops[i] = i;
+	}
+
+	for (t = 0; t < nthreads; t++)
+	{
+		r[t].trace = trace;
+		r[t].tracenum = tracenum;
+		r[t].self = t;
+		r[t].seq = seq;
+		r[t].done = done;
+		r[t].start = &start;
+		if (shared)
+		{
+			r[t].blocks = trace->blocks;
+			r[t].block_sizes = trace->block_sizes;
+		}
+		else
+		{
+			r[t].ops = ops;
+			r[t].num_ops = trace->num_ops;
+			r[t].blocks = (char **)malloc(trace->num_ids * sizeof(char *));
+			r[t].block_sizes = (size_t *)malloc(trace->num_ids * sizeof(size_t));
+			if (r[t].blocks == NULL || r[t].block_sizes == NULL)
+				unix_error("malloc failed in eval_mm_threads");
+			if ((r[t].heap = mm_heap_create(heap_limit)) == NULL)
+				unix_error("mm_heap_create failed in eval_mm_threads");
+		}
+	}
+
+	stats->ops = shared ? trace->num_ops : (double)trace->num_ops * nthreads;
+	stats->valid = 1;
+	stats->secs = DBL_MAX;
+	for (pass = 0; pass <= THREAD_REPS && stats->valid; pass++)
+	{
+		if (shared)
+		{
+			mem_reset_brk();
+			if (init_mm(trace) < 0)
+			{
+				malloc_error(tracenum, 0, "mm_init failed.");
+				stats->valid = 0;
+				break;
+			}
+			mm_set_locking(1);
+			memset(done, 0, trace->num_ids * sizeof(int));
+		}
+		else
+		{
+			for (t = 0; t < nthreads; t++)
+			{
+				if (mm_heap_reset(r[t].heap) < 0)
+					unix_error("mm_heap_reset failed in eval_mm_threads");
+			}
+		}
+		replay_failed = 0;
+		pthread_barrier_init(&start, NULL, nthreads + 1);
+		for (t = 0; t < nthreads; t++)
+		{
+			r[t].check = (pass == 0);
+			if ((ret = pthread_create(&tids[t], NULL, replay_thread, &r[t])) != 0)
+			{
+				errno = ret;
+				unix_error("pthread_create failed in eval_mm_threads");
+			}
+		}
+		/*
+		 * Time the pass from the first thread past the barrier: the last
+		 * one to arrive may run a long way before this thread wakes up
+		 */
+		pthread_barrier_wait(&start);
+		for (t = 0; t < nthreads; t++)
+			pthread_join(tids[t], NULL);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		t0 = r[0].t0;
+		for (t = 1; t < nthreads; t++)
+			if (r[t].t0.tv_sec < t0.tv_sec ||
+				(r[t].t0.tv_sec == t0.tv_sec && r[t].t0.tv_nsec < t0.tv_nsec))
+				t0 = r[t].t0;
+		pthread_barrier_destroy(&start);
+		if (shared)
+			mm_set_locking(0);
+
+		if (replay_failed)
+			stats->valid = 0;
+		else if (pass > 0)
+		{
+			secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+			if (secs < stats->secs)
+				stats->secs = secs;
+		}
+	}
+
+	if (!shared)
+	{
+		for (t = 0; t < nthreads; t++)
+		{
+			mm_heap_destroy(r[t].heap);
+			free(r[t].blocks);
+			free(r[t].block_sizes);
+		}
+	}
+	free(seq);
+	free(done);
+	free(ops);
+	free(tids);
+	free(r);
+}
+
+/*
+ * replay_thread - Run one thread's requests for eval_mm_threads, on its
+ *     own heap if it has one and on the default heap otherwise. When
+ *     checking, each payload is filled with a byte that depends on its
+ *     id (and, in the private mode, on the thread) and is checked again
+ *     on realloc and free, which catches a block handed out twice,
+ *     whichever threads got it.
+ */
+static void *replay_thread(void *ptr)
+{
+	replay_t *r = (replay_t *)ptr;
+	int salt = (r->done == NULL) ? r->self : 0;
+	int i, n, index, spins;
+	size_t size, oldsize;
+	unsigned char fill;
+	traceop_t *op;
+	char *p;
+
+	pthread_barrier_wait(r->start);
+	clock_gettime(CLOCK_MONOTONIC, &r->t0);
+	for (n = 0; n < r->num_ops; n++)
+	{
+		i = r->ops[n];
+		op = &r->trace->ops[i];
+		index = op->index;
+		size = op->size;
+		fill = (unsigned char)(index * 31 + salt * 131 + 1);
+
+		/* Shared mode: wait until the earlier requests on this id are done */
+		if (r->done != NULL)
+		{
+			for (spins = 0; __atomic_load_n(&r->done[index], __ATOMIC_ACQUIRE) != r->seq[i]; spins++)
+			{
+				if (__atomic_load_n(&replay_failed, __ATOMIC_RELAXED))
+					return NULL;
+				if (spins >= SPIN_YIELD)
+					sched_yield();
+			}
+		}
+
+		switch (op->type)
+		{
+
+		case ALLOC: /* mm_malloc */
+			p = (r->heap != NULL) ? mm_heap_malloc_hint(r->heap, size, op->hint)
+								  : mm_alloc_op(size, op->hint);
+			if (p == NULL)
+			{
+				replay_error(r, i, "mm_malloc failed.");
+				return NULL;
+			}
+			if (r->check && !replay_check(r, i, p, size, 0, fill))
+				return NULL;
+			r->blocks[index] = p;
+			r->block_sizes[index] = size;
+			break;
+
+		case REALLOC: /* mm_realloc */
+			oldsize = r->block_sizes[index];
+			p = (r->heap != NULL) ? mm_heap_realloc(r->heap, r->blocks[index], size)
+								  : mm_realloc(r->blocks[index], size);
+			if (p == NULL)
+			{
+				replay_error(r, i, "mm_realloc failed.");
+				return NULL;
+			}
+			if (r->check && !replay_check(r, i, p, size,
+										  size < oldsize ? size : oldsize, fill))
+				return NULL;
+			r->blocks[index] = p;
+			r->block_sizes[index] = size;
+			break;
+
+		case FREE: /* mm_free */
+			p = r->blocks[index];
+			if (r->check && !replay_check(r, i, p, r->block_sizes[index],
+										  r->block_sizes[index], fill))
+				return NULL;
+			if (r->heap != NULL)
+				mm_heap_free(r->heap, p);
+			else
+				mm_free_op(p);
+			break;
+
+		default:
+			app_error("Nonexistent request type in replay_thread");
+		}
+
+		if (r->done != NULL)
+			__atomic_store_n(&r->done[index], r->seq[i] + 1, __ATOMIC_RELEASE);
+	}
+	if (quick && r->heap == NULL)
+		mm_quick_flush(); /* the quick lists die with the thread */
+	return NULL;
+}
+
+/*
+ * replay_check - Check a payload of size bytes for replay_thread: it
+ *     must be aligned and inside the thread's heap, and its first keep
+ *     bytes must still hold fill. Unless the block is about to be freed
+ *     (keep == size), it is then filled with fill. The heap bounds are
+ *     read by mm_heap_contains under the heap lock, since other threads
+ *     may be growing a shared heap meanwhile.
+ */
+static int replay_check(replay_t *r, int opnum, char *p, size_t size,
+						size_t keep, unsigned char fill)
+{
+	char msg[MAXLINE];
+	size_t j;
+
+	if (!IS_ALIGNED(p))
+	{
+		sprintf(msg, "Payload address (%p) not aligned to %d bytes",
+				p, ALIGNMENT);
+		replay_error(r, opnum, msg);
+		return 0;
+	}
+	if (!((r->heap != NULL) ? mm_heap_contains(r->heap, p, size)
+							: mm_contains(p, size)))
+	{
+		sprintf(msg, "Payload (%p:%p) lies outside heap", p, p + size - 1);
+		replay_error(r, opnum, msg);
+		return 0;
+	}
+	for (j = 0; j < keep; j++)
+	{
+		if ((unsigned char)p[j] != fill)
+		{
+			sprintf(msg, "Payload (%p:%p) changed at byte %zu while allocated",
+					p, p + size - 1, j);
+			replay_error(r, opnum, msg);
+			return 0;
+		}
+	}
+	if (keep < size)
+		memset(p, fill, size);
+	return 1;
+}
+
+/*
+ * replay_error - Report an error found by a replay thread and make the
+ *     other threads stop waiting for it
+ */
+static void replay_error(replay_t *r, int opnum, char *msg)
+{
+	pthread_mutex_lock(&print_lock);
+	errors++;
+	printf("ERROR [trace %d, line %d, thread %d]: %s\n",
+		   r->tracenum, LINENUM(opnum), r->self, msg);
+	pthread_mutex_unlock(&print_lock);
+	__atomic_store_n(&replay_failed, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * eval_mm_lines - Count the small (at most CACHE_LINE bytes) alloc and
+ *    realloc requests in a trace, and how many of them got a payload
+ *    that crosses a CACHE_LINE boundary. Such a block costs two cache
+ *    misses on every access where one would do.
+ */
+static void eval_mm_lines(trace_t *trace, stats_t *stats)
+{
+	int i, index;
+	size_t size;
+	char *p;
+
+	mem_reset_brk();
+	if (init_mm(trace) < 0)
+		app_error("mm_init failed in eval_mm_lines");
+
+	stats->small = 0;
+	stats->straddle = 0;
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		index = trace->ops[i].index;
+		size = trace->ops[i].size;
+		switch (trace->ops[i].type)
+		{
+		case ALLOC:
+		case REALLOC:
+			if (trace->ops[i].type == ALLOC)
+				p = mm_alloc_op(size, trace->ops[i].hint);
+			else
+				p = mm_realloc(trace->blocks[index], size);
+			if (p == NULL)
+				app_error("mm_malloc failed in eval_mm_lines");
+			trace->blocks[index] = p;
+			if (size > 0 && size <= CACHE_LINE)
+			{
+				stats->small++;
+				if (((uintptr_t)p % CACHE_LINE) + size > CACHE_LINE)
+					stats->straddle++;
+			}
+			break;
+
+		case FREE:
+			mm_free_op(trace->blocks[index]);
+			break;
+
+		default:
+			app_error("Nonexistent request type in eval_mm_lines");
+		}
+	}
+}
+
+/*
+ * eval_mm_touch - Like eval_mm_speed, but the replay also uses the
+ *    blocks: every new block is written in full and every block is read
+ *    in full before it is freed. Timed by fcyc, so the result shows how
+ *    placement affects the program using the memory, not just the
+ *    allocator.
+ */
+static void eval_mm_touch(void *ptr)
+{
+	int i, index;
+	size_t j, size;
+	char *p;
+	unsigned char sum = 0;
+	trace_t *trace = ((speed_t *)ptr)->trace;
+
+	mem_reset_brk();
+	if (init_mm(trace) < 0)
+		app_error("mm_init failed in eval_mm_touch");
+
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		index = trace->ops[i].index;
+		size = trace->ops[i].size;
+		switch (trace->ops[i].type)
+		{
+		case ALLOC:
+			if ((p = mm_alloc_op(size, trace->ops[i].hint)) == NULL)
+				app_error("mm_malloc error in eval_mm_touch");
+			memset(p, index & 0xFF, size);
+			trace->blocks[index] = p;
+			trace->block_sizes[index] = size;
+			break;
+
+		case REALLOC:
+			if ((p = mm_realloc(trace->blocks[index], size)) == NULL)
+				app_error("mm_realloc error in eval_mm_touch");
+			memset(p, index & 0xFF, size);
+			trace->blocks[index] = p;
+			trace->block_sizes[index] = size;
+			break;
+
+		case FREE:
+			p = trace->blocks[index];
+			for (j = 0; j < trace->block_sizes[index]; j++)
+				sum += p[j];
+			mm_free_op(p);
+			break;
+
+		default:
+			app_error("Nonexistent request type in eval_mm_touch");
+		}
+	}
+	/* keep the reads from being optimized away */
+	*(volatile unsigned char *)&sum = sum;
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -878,7 +1798,8 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace, int tracenum)
 {
-	int i, newsize;
+	int i;
+	size_t newsize;
 	char *p, *newp, *oldp;
 
 	for (i = 0; i < trace->num_ops; i++)
@@ -926,7 +1847,8 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 static void eval_libc_speed(void *ptr)
 {
 	int i;
-	int index, size, newsize;
+	int index;
+	size_t size, newsize;
 	char *p, *newp, *oldp, *block;
 	trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -976,13 +1898,13 @@ static void printresults(int n, stats_t *stats)
 	double util = 0;
 
 	/* Print the individual results for each trace */
-	printf("%5s%7s %5s%8s%10s%6s\n",
+	printf("%5s%7s %5s%8s%10s%7s\n",
 		   "trace", " valid", "util", "ops", "secs", "Kops");
 	for (i = 0; i < n; i++)
 	{
 		if (stats[i].valid)
 		{
-			printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n",
+			printf("%2d%10s%5.0f%%%8.0f%10.6f%7.0f\n",
 				   i,
 				   "yes",
 				   stats[i].util * 100.0,
@@ -995,7 +1917,7 @@ static void printresults(int n, stats_t *stats)
 		}
 		else
 		{
-			printf("%2d%10s%6s%8s%10s%6s\n",
+			printf("%2d%10s%6s%8s%10s%7s\n",
 				   i,
 				   "no",
 				   "-",
@@ -1008,7 +1930,7 @@ static void printresults(int n, stats_t *stats)
 	/* Print the aggregate results for the set of traces */
 	if (errors == 0)
 	{
-		printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n",
+		printf("%12s%5.0f%%%8.0f%10.6f%7.0f\n",
 			   "Total       ",
 			   (util / n) * 100.0,
 			   ops,
@@ -1026,6 +1948,104 @@ static void printresults(int n, stats_t *stats)
 	}
 }
 
+/*
+ * printlines - prints the cache-line stats gathered with -c
+ */
+static void printlines(int n, stats_t *stats)
+{
+	int i;
+	double small = 0, straddle = 0, ops = 0, secs = 0;
+
+	printf("%5s%8s%10s%10s%10s\n",
+		   "trace", "small", "straddle", "secs", "touchKops");
+	for (i = 0; i < n; i++)
+	{
+		if (!stats[i].valid)
+		{
+			printf("%2d%11s%10s%10s%10s\n", i, "-", "-", "-", "-");
+			continue;
+		}
+		printf("%2d%11.0f%9.1f%%%10.6f%10.0f\n",
+			   i,
+			   stats[i].small,
+			   stats[i].small ? stats[i].straddle * 100.0 / stats[i].small : 0.0,
+			   stats[i].touch_secs,
+			   (stats[i].ops / 1e3) / stats[i].touch_secs);
+		small += stats[i].small;
+		straddle += stats[i].straddle;
+		ops += stats[i].ops;
+		secs += stats[i].touch_secs;
+	}
+	if (errors == 0)
+		printf("%-5s%8.0f%9.1f%%%10.6f%10.0f\n",
+			   "Total",
+			   small,
+			   small ? straddle * 100.0 / small : 0.0,
+			   secs,
+			   (ops / 1e3) / secs);
+}
+
+/*
+ * printthreads - prints the -T results: per trace with -v, and the
+ *     total over all traces for each thread count. Speedup is relative
+ *     to one thread.
+ */
+static void printthreads(int n, int ncounts, int *counts, stats_t *stats)
+{
+	int i, j, valid;
+	double ops, secs, base;
+	stats_t *s;
+
+	printf("%5s%8s%7s%10s%10s%8s%10s%9s\n",
+		   "trace", "threads", " valid", "ops", "secs", "Kops", "Kops/thr", "speedup");
+	for (i = 0; verbose && i < n; i++)
+	{
+		s = &stats[i * ncounts];
+		base = s[0].ops / s[0].secs;
+		for (j = 0; j < ncounts; j++)
+		{
+			if (!s[j].valid || !s[0].valid)
+			{
+				printf("%5d%8d%7s%10s%10s%8s%10s%9s\n",
+					   i, counts[j], "no", "-", "-", "-", "-", "-");
+				continue;
+			}
+			printf("%5d%8d%7s%10.0f%10.6f%8.0f%10.0f%8.2fx\n",
+				   i, counts[j], "yes", s[j].ops, s[j].secs,
+				   (s[j].ops / 1e3) / s[j].secs,
+				   (s[j].ops / 1e3) / s[j].secs / counts[j],
+				   (s[j].ops / s[j].secs) / base);
+		}
+	}
+
+	/* Totals over the traces, one line per thread count */
+	base = 0;
+	for (j = 0; j < ncounts; j++)
+	{
+		ops = secs = 0;
+		valid = 1;
+		for (i = 0; i < n; i++)
+		{
+			s = &stats[i * ncounts + j];
+			valid = valid && s->valid;
+			ops += s->ops;
+			secs += s->secs;
+		}
+		if (!valid)
+		{
+			printf("%-5s%8d%7s%10s%10s%8s%10s%9s\n",
+				   "Total", counts[j], "no", "-", "-", "-", "-", "-");
+			continue;
+		}
+		if (base == 0)
+			base = ops / secs;
+		printf("%-5s%8d%7s%10.0f%10.6f%8.0f%10.0f%8.2fx\n",
+			   "Total", counts[j], "yes", ops, secs,
+			   (ops / 1e3) / secs, (ops / 1e3) / secs / counts[j],
+			   (ops / secs) / base);
+	}
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1044,6 +2064,52 @@ void unix_error(char *msg)
 	exit(1);
 }
 
+/*
+ * parse_size - Convert a byte count with an optional K, M or G suffix
+ *     (e.g. "20M", "8G") to a number of bytes. Returns 0 on bad input,
+ *     including counts that do not fit in a size_t.
+ */
+static size_t parse_size(char *str)
+{
+	char *end;
+	unsigned long long size;
+	int shift = 0;
+
+	errno = 0;
+	size = strtoull(str, &end, 0);
+	if (errno == ERANGE || end == str || *str == '-' || size > SIZE_MAX)
+		return 0;
+
+	switch (*end)
+	{
+	case 'g':
+	case 'G':
+		shift += 10; /* fall through */
+	case 'm':
+	case 'M':
+		shift += 10; /* fall through */
+	case 'k':
+	case 'K':
+		shift += 10;
+		end++;
+		break;
+	}
+	if (*end != '\0' || size > (SIZE_MAX >> shift))
+		return 0;
+	return (size_t)size << shift;
+}
+
+/*
+ * engine_heap - Simulated heap size for engine. Buddy blocks are rounded
+ *     up to a power of two, so a trace can need up to twice the memory it
+ *     needs with the segregated lists; the buddy engine gets twice the
+ *     heap limit so that every trace runs to the end.
+ */
+static size_t engine_heap(int engine, size_t heap_limit)
+{
+	return (engine == MM_ENGINE_BUDDY) ? 2 * heap_limit : heap_limit;
+}
+
 /*
  * malloc_error - Report an error returned by the mm_malloc package
  */
@@ -1058,14 +2124,22 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void)
 {
-	fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+	fprintf(stderr, "Usage: mdriver [-hvValcbqS] [-f <file>] [-t <dir>] [-H <size>] [-L <ops>] [-N <size>] [-T <threads>]\n");
 	fprintf(stderr, "Options\n");
 	fprintf(stderr, "\t-a         Don't check the team structure.\n");
+	fprintf(stderr, "\t-b         Run the buddy engine as well (on twice the heap limit) and print both tables.\n");
+	fprintf(stderr, "\t-c         Measure cache-line straddling and payload-touching replay.\n");
 	fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
 	fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
 	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr, "\t-H <size>  Heap limit in bytes, K/M/G suffix allowed (default %d).\n", MAX_HEAP);
 	fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+	fprintf(stderr, "\t-L <ops>   Hint blocks freed within <ops> requests as short-lived.\n");
+	fprintf(stderr, "\t-N <size>  Copy realloc moves of <size> bytes or more with streaming stores (0 = never).\n");
+	fprintf(stderr, "\t-q         Replay mallocs and frees through the inline fast path (mm_inline.h).\n");
+	fprintf(stderr, "\t-S         Start each heap with the trace's suggested heap size reserved.\n");
 	fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+	fprintf(stderr, "\t-T <n>     Replay the traces on 1, 2, 4, ... <n> threads and report the scaling.\n");
 	fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
 	fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
@@ -2,6 +2,14 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            The simulated heap is a region: a reserved VM area with its
+ *            own brk pointer. The mem_xxx functions operate on a single
+ *            default region, and mem_region_xxx lets callers create any
+ *            number of independent regions. A region may also be backed
+ *            by a file (mem_region_open), which keeps its heap across
+ *            processes. A region that cannot grow further can get
+ *            extra segments at unrelated addresses (mem_segment_create).
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,28 +18,79 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* A region: one reserved VM area with its own brk */
+struct mem_region {
+    unsigned int magic;      /* REGION_MAGIC once a file-backed region is set up */
+    int fd;                  /* backing file, or -1 for anonymous memory */
+    char *map_start;         /* start of the mapping (may hold this struct) */
+    size_t map_size;         /* size of the mapping in bytes */
+    char *start_brk;         /* points to first byte of heap */
+    char *brk;               /* points to last byte of heap */
+    char *max_addr;          /* largest legal heap address */
+    mem_region_t *segs;      /* segments added with mem_segment_create */
+    mem_region_t *owner;     /* for a segment: the region it belongs to */
+    mem_region_t *next_seg;  /* for a segment: next segment of the owner */
+    int spill;               /* 1: segments may take the footprint past max heap */
+    size_t peak;             /* largest footprint before the last shrink */
+};
+
+/* Regions keep their descriptor in the first bytes of their mapping */
+#define REGION_HDR_SIZE ((sizeof(mem_region_t) + 63) & ~(size_t)63)
+#define REGION_MAGIC 0x6d656d72   /* "memr" */
+
+/* 1: purge free pages with MADV_FREE instead of MADV_DONTNEED */
+#ifndef PURGE_LAZY
+#define PURGE_LAZY 0
+#endif
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_region_t mem_default;  /* region behind the mem_xxx functions */
+
+/*
+ * mem_map - reserve size bytes of address space. MAP_NORESERVE means
+ *    multi-gigabyte limits only cost address space until the allocator
+ *    actually touches the pages.
+ */
+static char *mem_map(size_t size)
+{
+    char *p = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return (p == MAP_FAILED) ? NULL : p;
+}
 
 /* 
- * mem_init - initialize the memory system model
+ * mem_init - initialize the memory system model with the default
+ *    MAX_HEAP limit from config.h
  */
 void mem_init(void)
+{
+    mem_init_size(MAX_HEAP);
+}
+
+/*
+ * mem_init_size - initialize the memory system model with a heap
+ *    limit of max_heap bytes.
+ */
+void mem_init_size(size_t max_heap)
 {
     /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    if ((mem_default.map_start = mem_map(max_heap)) == NULL) {
+	fprintf(stderr, "mem_init_vm: mmap error: %s\n", strerror(errno));
 	exit(1);
     }
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_default.fd = -1;
+    mem_default.map_size = max_heap;
+    mem_default.start_brk = mem_default.map_start;
+    mem_default.max_addr = mem_default.start_brk + max_heap;  /* max legal heap address */
+    mem_default.brk = mem_default.start_brk;                  /* heap is empty initially */
+    mem_default.spill = 0;
 }
 
 /* 
@@ -39,7 +98,8 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    mem_region_reset_brk(&mem_default);   /* drops the segments */
+    munmap(mem_default.map_start, mem_default.map_size);
 }
 
 /*
@@ -47,7 +107,7 @@ void mem_deinit(void)
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    mem_region_reset_brk(&mem_default);
 }
 
 /* 
@@ -55,17 +115,9 @@ void mem_reset_brk()
  *    by incr bytes and returns the start address of the new area. In
  *    this model, the heap cannot be shrunk.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
-
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
-	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
-	return (void *)-1;
-    }
-    mem_brk += incr;
-    return (void *)old_brk;
+    return mem_region_sbrk(&mem_default, incr);
 }
 
 /*
@@ -73,7 +125,7 @@ void *mem_sbrk(int incr)
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return mem_region_lo(&mem_default);
 }
 
 /* 
@@ -81,7 +133,7 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return mem_region_hi(&mem_default);
 }
 
 /*
@@ -89,7 +141,25 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_region_footprint(&mem_default);
+}
+
+/*
+ * mem_heap_peak - returns the largest heap size (segments included)
+ *    since the last mem_reset_brk
+ */
+size_t mem_heap_peak()
+{
+    return mem_region_peak(&mem_default);
+}
+
+/*
+ * mem_heap_contains - true if [lo, hi] lies inside the default heap or
+ *    inside one of its segments
+ */
+int mem_heap_contains(const void *lo, const void *hi)
+{
+    return mem_region_contains(&mem_default, lo, hi);
 }
 
 /*
@@ -99,3 +169,489 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_default_region - return the region used by the mem_xxx functions
+ */
+mem_region_t *mem_default_region(void)
+{
+    return &mem_default;
+}
+
+/*
+ * mem_region_create - reserve a new, empty region whose heap may grow
+ *    to max_heap bytes. Returns NULL if the address space is not
+ *    available.
+ */
+mem_region_t *mem_region_create(size_t max_heap)
+{
+    size_t map_size = REGION_HDR_SIZE + max_heap;
+    char *map = mem_map(map_size);
+    mem_region_t *r;
+
+    if (map == NULL)
+	return NULL;
+
+    r = (mem_region_t *)map;
+    r->fd = -1;
+    r->map_start = map;
+    r->map_size = map_size;
+    r->start_brk = map + REGION_HDR_SIZE;
+    r->max_addr = r->start_brk + max_heap;
+    r->brk = r->start_brk;
+    return r;
+}
+
+/*
+ * mem_region_destroy - release a region and every byte of its heap
+ */
+void mem_region_destroy(mem_region_t *r)
+{
+    int fd = r->fd;
+
+    while (r->segs != NULL)
+	mem_segment_destroy(r->segs);
+    munmap(r->map_start, r->map_size);
+    if (fd >= 0)
+	close(fd);
+}
+
+/*
+ * mem_region_open - map the file at path as a region whose heap may
+ *    grow to max_heap bytes, creating the file if needed. The region
+ *    descriptor lives in the first bytes of the file and records the
+ *    address the file was last mapped at; the file is mapped there
+ *    again when that address is free, and the brk is rebased otherwise
+ *    (the caller compares the address with r to tell). Space taken off
+ *    the top with mem_region_reserve_top stays reserved across opens.
+ *    *existed tells whether the file already held a region. Returns
+ *    NULL (errno set) if the file cannot be mapped or its header is
+ *    not sane.
+ */
+mem_region_t *mem_region_open(const char *path, size_t max_heap, int *existed)
+{
+    mem_region_t old;
+    size_t map_size = REGION_HDR_SIZE + max_heap;
+    size_t brk_off = REGION_HDR_SIZE;
+    size_t top_off = 0;         /* 0: nothing reserved at the top */
+    char *hint = NULL, *map;
+    struct stat st;
+    mem_region_t *r;
+    int fd;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+	return NULL;
+    if (fstat(fd, &st) < 0) {
+	close(fd);
+	return NULL;
+    }
+
+    /* a non-empty file must hold a region; never overwrite anything else */
+    *existed = (st.st_size != 0);
+    if (*existed) {
+	if (pread(fd, &old, sizeof(old), 0) != sizeof(old) ||
+	    old.magic != REGION_MAGIC ||
+	    (size_t)(old.start_brk - old.map_start) != REGION_HDR_SIZE ||
+	    old.brk < old.start_brk || old.brk > old.max_addr ||
+	    old.max_addr > old.map_start + old.map_size ||
+	    (size_t)st.st_size < old.map_size) {
+	    close(fd);
+	    errno = EINVAL;
+	    return NULL;
+	}
+	if (old.map_size > map_size)
+	    map_size = old.map_size;    /* never cut off an existing heap */
+	brk_off = old.brk - old.map_start;
+	if (old.max_addr < old.map_start + old.map_size)
+	    top_off = old.max_addr - old.map_start;   /* data lives above it */
+	hint = old.map_start;
+    }
+    if ((size_t)st.st_size < map_size && ftruncate(fd, map_size) < 0) {
+	close(fd);
+	return NULL;
+    }
+
+    /* the address is only a hint: a different one just means a rebase */
+    map = (char *)mmap(hint, map_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_NORESERVE, fd, 0);
+    if (map == MAP_FAILED) {
+	close(fd);
+	return NULL;
+    }
+
+    r = (mem_region_t *)map;
+    r->magic = REGION_MAGIC;
+    r->fd = fd;
+    r->map_start = map;
+    r->map_size = map_size;
+    r->start_brk = map + REGION_HDR_SIZE;
+    r->brk = map + brk_off;
+    r->max_addr = map + (top_off ? top_off : map_size);
+    r->segs = r->owner = r->next_seg = NULL;   /* stale pointers of another process */
+    r->peak = 0;
+    return r;
+}
+
+/*
+ * mem_region_create_shared - like mem_region_create, but the region is
+ *    a shared mapping. With name == NULL it is anonymous and shared with
+ *    children forked later; otherwise it is the new POSIX shared memory
+ *    object name, which other processes can map with mem_region_attach.
+ */
+mem_region_t *mem_region_create_shared(const char *name, size_t max_heap)
+{
+    size_t map_size = REGION_HDR_SIZE + max_heap;
+    int flags = MAP_SHARED | MAP_NORESERVE;
+    mem_region_t *r;
+    char *map;
+    int fd = -1;
+
+    if (name == NULL)
+	flags |= MAP_ANONYMOUS;
+    else {
+	if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0)
+	    return NULL;
+	if (ftruncate(fd, map_size) < 0) {
+	    close(fd);
+	    shm_unlink(name);
+	    return NULL;
+	}
+    }
+    map = (char *)mmap(NULL, map_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (fd >= 0)
+	close(fd);                  /* the mapping keeps the object alive */
+    if (map == MAP_FAILED) {
+	if (name != NULL)
+	    shm_unlink(name);
+	return NULL;
+    }
+
+    r = (mem_region_t *)map;
+    r->magic = REGION_MAGIC;
+    r->fd = -1;
+    r->map_start = map;
+    r->map_size = map_size;
+    r->start_brk = map + REGION_HDR_SIZE;
+    r->max_addr = map + map_size;
+    r->brk = r->start_brk;
+    return r;
+}
+
+/*
+ * mem_region_attach - map the shared region name at the address its
+ *    creator uses, so that pointers into it mean the same thing in every
+ *    process. Fails with EADDRINUSE if any part of that range is already
+ *    mapped here (another library, a different binary, ASLR); nothing
+ *    can be done about it then but attaching from another process.
+ */
+mem_region_t *mem_region_attach(const char *name)
+{
+    mem_region_t hdr;
+    char *map;
+    int fd;
+
+    if ((fd = shm_open(name, O_RDWR, 0)) < 0)
+	return NULL;
+    if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	hdr.magic != REGION_MAGIC) {
+	close(fd);
+	errno = EINVAL;
+	return NULL;
+    }
+    /* never move or replace a mapping: the range must be free as a whole */
+    map = (char *)mmap(hdr.map_start, hdr.map_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_NORESERVE | MAP_FIXED_NOREPLACE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+	if (errno == EEXIST)
+	    errno = EADDRINUSE;
+	return NULL;
+    }
+    if (map != hdr.map_start) {        /* kernels before 4.17 take it as a hint */
+	munmap(map, hdr.map_size);
+	errno = EADDRINUSE;
+	return NULL;
+    }
+    return (mem_region_t *)map;
+}
+
+/*
+ * mem_region_unlink - remove the name of a shared region; processes
+ *    that have it mapped keep using it
+ */
+int mem_region_unlink(const char *name)
+{
+    return shm_unlink(name);
+}
+
+/*
+ * mem_region_reserve_top - take size bytes off the top of a region,
+ *    below its current limit, for data that must live inside the
+ *    region but outside the heap. The heap can no longer grow into
+ *    them. Returns NULL if the heap already reaches that far.
+ */
+void *mem_region_reserve_top(mem_region_t *r, size_t size)
+{
+    char *top;
+
+    if (size > (size_t)(r->max_addr - r->brk) ||
+	(top = (char *)((uintptr_t)(r->max_addr - size) & ~(uintptr_t)63)) < r->brk) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    r->max_addr = top;
+    return top;
+}
+
+/*
+ * mem_region_release_top - give back everything taken with
+ *    mem_region_reserve_top, once the data kept there is no longer
+ *    needed. The space is cleared, so that it reads as zero when it is
+ *    reserved again, like the untouched top of a new region.
+ */
+void mem_region_release_top(mem_region_t *r)
+{
+    char *end = r->map_start + r->map_size;
+
+    memset(r->max_addr, 0, end - r->max_addr);
+    r->max_addr = end;
+}
+
+/*
+ * mem_region_sync - write the heap of a file-backed region, and what
+ *    is reserved at its top, back to its file. Does nothing for
+ *    anonymous regions.
+ */
+int mem_region_sync(mem_region_t *r)
+{
+    size_t page = mem_pagesize();
+    size_t len = ((r->brk - r->map_start) + page - 1) & ~(page - 1);
+    char *top = (char *)((uintptr_t)r->max_addr & ~(uintptr_t)(page - 1));
+
+    if (r->fd < 0)
+	return 0;
+    if (msync(r->map_start, len, MS_SYNC) < 0)
+	return -1;
+    if (top < r->map_start + r->map_size)
+	return msync(top, r->map_start + r->map_size - top, MS_SYNC);
+    return 0;
+}
+
+/*
+ * mem_region_reset_brk - reset the brk pointer of a region to make an
+ *    empty heap
+ */
+void mem_region_reset_brk(mem_region_t *r)
+{
+    while (r->segs != NULL)
+	mem_segment_destroy(r->segs);
+    r->brk = r->start_brk;
+    r->peak = 0;
+}
+
+/*
+ * mem_segment_create - add an independent segment to region r, for a
+ *    heap that cannot grow r any further. A segment is an anonymous
+ *    region of its own, at any address, whose heap may grow to
+ *    max(size, max heap of r) bytes; it goes away with r (destroy or
+ *    reset) unless released earlier. The bytes a segment takes count
+ *    against the max heap of r (see mem_segment_room). Returns NULL if
+ *    no address space is left.
+ */
+mem_region_t *mem_segment_create(mem_region_t *r, size_t size)
+{
+    size_t max_heap = (size_t)(r->max_addr - r->start_brk);
+    mem_region_t *seg;
+
+    if ((seg = mem_region_create(size > max_heap ? size : max_heap)) == NULL)
+	return NULL;
+    seg->owner = r;
+    seg->next_seg = r->segs;
+    r->segs = seg;
+    return seg;
+}
+
+/*
+ * mem_segment_room - returns how many more bytes region r and its
+ *    segments may take in all: the max heap of r less their footprint,
+ *    or SIZE_MAX if r may spill past it (mem_region_set_spill)
+ */
+size_t mem_segment_room(mem_region_t *r)
+{
+    size_t limit = (size_t)(r->max_addr - r->start_brk);
+    size_t size = mem_region_footprint(r);
+
+    if (r->spill)
+	return SIZE_MAX;
+    return (size < limit) ? limit - size : 0;
+}
+
+/*
+ * mem_region_set_spill - let the segments of r grow its footprint past
+ *    the max heap of r (on != 0), for a client whose max heap only
+ *    sizes the address space it reserves up front
+ */
+void mem_region_set_spill(mem_region_t *r, int on)
+{
+    r->spill = (on != 0);
+}
+
+/*
+ * mem_segment_destroy - release one segment before its region goes
+ */
+void mem_segment_destroy(mem_region_t *seg)
+{
+    mem_region_t **pp = &seg->owner->segs;
+
+    mem_region_peak(seg->owner);   /* remember the size before it drops */
+    while (*pp != seg)
+	pp = &(*pp)->next_seg;
+    *pp = seg->next_seg;
+    munmap(seg->map_start, seg->map_size);
+}
+
+/*
+ * mem_region_sbrk - mem_sbrk on a specific region
+ */
+void *mem_region_sbrk(mem_region_t *r, intptr_t incr)
+{
+    char *old_brk = r->brk;
+
+    if ( (incr < 0) || ((size_t)incr > mem_region_room(r))) {
+	errno = ENOMEM;
+	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+    r->brk += incr;
+    return (void *)old_brk;
+}
+
+/*
+ * mem_region_trim - shrink the heap of a region by decr bytes and give
+ *    the whole pages above the new brk back to the OS. Returns -1 if
+ *    the heap is smaller than decr.
+ */
+int mem_region_trim(mem_region_t *r, size_t decr)
+{
+    size_t page = mem_pagesize();
+    char *lo, *hi;
+
+    if (decr > (size_t)(r->brk - r->start_brk)) {
+	errno = EINVAL;
+	return -1;
+    }
+    mem_region_peak(r->owner != NULL ? r->owner : r);
+    r->brk -= decr;
+
+    lo = r->map_start + ((r->brk - r->map_start + page - 1) & ~(page - 1));
+    hi = r->map_start + ((r->brk + decr - r->map_start) & ~(page - 1));
+    if (hi > lo)
+	madvise(lo, hi - lo, MADV_DONTNEED);
+    return 0;
+}
+
+/*
+ * mem_region_purge - give the pages in [addr, addr + len) back to the
+ *    OS while keeping them mapped. They read back as either their old
+ *    contents or zeros. addr and len must be page aligned and the
+ *    range must lie inside the heap of region r; returns -1 with
+ *    errno EINVAL otherwise.
+ */
+int mem_region_purge(mem_region_t *r, void *addr, size_t len)
+{
+    if ((char *)addr < r->start_brk || (char *)addr > r->brk ||
+	len > (size_t)(r->brk - (char *)addr)) {
+	errno = EINVAL;
+	return -1;
+    }
+#if PURGE_LAZY && defined(MADV_FREE)
+    /* lazy: cheaper, but the kernel takes the pages (and RSS drops)
+       only under memory pressure */
+    if (madvise(addr, len, MADV_FREE) == 0)
+	return 0;
+#endif
+    return madvise(addr, len, MADV_DONTNEED);
+}
+
+/*
+ * mem_region_lo - return address of the first heap byte of a region
+ */
+void *mem_region_lo(mem_region_t *r)
+{
+    return (void *)r->start_brk;
+}
+
+/*
+ * mem_region_hi - return address of the last heap byte of a region
+ */
+void *mem_region_hi(mem_region_t *r)
+{
+    return (void *)(r->brk - 1);
+}
+
+/*
+ * mem_region_heapsize - returns the heap size of a region in bytes
+ */
+size_t mem_region_heapsize(mem_region_t *r)
+{
+    return (size_t)(r->brk - r->start_brk);
+}
+
+/*
+ * mem_region_room - returns how many more bytes the heap of a region
+ *    can grow. Once a region has segments, it and its segments share
+ *    the max heap of the region (mem_segment_room).
+ */
+size_t mem_region_room(mem_region_t *r)
+{
+    size_t room = (size_t)(r->max_addr - r->brk);
+    mem_region_t *owner = (r->owner != NULL) ? r->owner : r;
+    size_t shared;
+
+    if (owner->segs == NULL)
+	return room;
+    shared = mem_segment_room(owner);
+    return (shared < room) ? shared : room;
+}
+
+/*
+ * mem_region_footprint - heap size of a region plus its segments
+ */
+size_t mem_region_footprint(mem_region_t *r)
+{
+    size_t size = mem_region_heapsize(r);
+    mem_region_t *seg;
+
+    for (seg = r->segs; seg != NULL; seg = seg->next_seg)
+	size += mem_region_heapsize(seg);
+    return size;
+}
+
+/*
+ * mem_region_peak - returns the largest footprint of a region since its
+ *    last reset. The footprint only drops on trim and segment release,
+ *    so it is recorded there.
+ */
+size_t mem_region_peak(mem_region_t *r)
+{
+    size_t size = mem_region_footprint(r);
+
+    if (size > r->peak)
+	r->peak = size;
+    return r->peak;
+}
+
+/*
+ * mem_region_contains - true if [lo, hi] lies inside the heap of r or
+ *    inside the heap of one of its segments
+ */
+int mem_region_contains(mem_region_t *r, const void *lo, const void *hi)
+{
+    const char *l = lo, *h = hi;
+
+    for (; r != NULL; r = (r->owner == NULL) ? r->segs : r->next_seg) {
+	if (l >= r->start_brk && h < r->brk)
+	    return 1;
+    }
+    return 0;
+}
@@ -1,11 +1,46 @@
 #include <unistd.h>
+#include <stdint.h>
 
 void mem_init(void);               
+void mem_init_size(size_t max_heap);
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_heap_peak(void);
+int mem_heap_contains(const void *lo, const void *hi);
 size_t mem_pagesize(void);
 
+/* Independent simulated heaps, each with its own brk */
+typedef struct mem_region mem_region_t;
+
+mem_region_t *mem_default_region(void);
+mem_region_t *mem_region_create(size_t max_heap);
+void mem_region_destroy(mem_region_t *r);
+mem_region_t *mem_region_open(const char *path, size_t max_heap, int *existed);
+int mem_region_sync(mem_region_t *r);
+mem_region_t *mem_region_create_shared(const char *name, size_t max_heap);
+mem_region_t *mem_region_attach(const char *name);
+int mem_region_unlink(const char *name);
+void *mem_region_reserve_top(mem_region_t *r, size_t size);
+void mem_region_release_top(mem_region_t *r);
+void mem_region_reset_brk(mem_region_t *r);
+void *mem_region_sbrk(mem_region_t *r, intptr_t incr);
+int mem_region_trim(mem_region_t *r, size_t decr);
+int mem_region_purge(mem_region_t *r, void *addr, size_t len);
+void *mem_region_lo(mem_region_t *r);
+void *mem_region_hi(mem_region_t *r);
+size_t mem_region_heapsize(mem_region_t *r);
+size_t mem_region_room(mem_region_t *r);
+size_t mem_region_footprint(mem_region_t *r);
+size_t mem_region_peak(mem_region_t *r);
+int mem_region_contains(mem_region_t *r, const void *lo, const void *hi);
+
+/* Extra non-contiguous segments of a region (when it cannot grow) */
+mem_region_t *mem_segment_create(mem_region_t *r, size_t size);
+void mem_segment_destroy(mem_region_t *seg);
+size_t mem_segment_room(mem_region_t *r);
+void mem_region_set_spill(mem_region_t *r, int on);
+
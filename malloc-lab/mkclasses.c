@@ -0,0 +1,350 @@
+/*
+ * mkclasses.c - Generate a profile-guided size-class table for mm.c
+ *
+ * Reads a set of .rep trace files, builds a histogram of the block
+ * sizes that mm.c will actually request (payload plus boundary tags,
+ * rounded the same way mm_malloc rounds), and splits the small-size
+ * range into contiguous classes with dynamic programming.
+ * The cost of a class is the internal fragmentation it would cause if
+ * every request in it were served by a block of the class upper bound,
+ * plus a penalty proportional to the square of its population, which
+ * models the expected length of its free list. The penalty is scaled by
+ * the mean block size so that -w 1 trades one average block of waste
+ * for one expected list entry.
+ *
+ * Sizes above the table range fall into power-of-two classes, and the
+ * last class catches everything else, like the original get_list_index.
+ *
+ * The output is a C header (sizeclass.h) that mm.c includes in place
+ * of the old shift loop. Block sizes depend on the payload alignment
+ * and, through the minimum block, on the pointer size, so the header
+ * holds one table per layout mm.c can be built with (ALIGNMENT 8 or 16,
+ * 64- or 32-bit pointers) and the preprocessor picks the one matching
+ * the build.
+ *
+ *   usage: mkclasses [-n classes] [-m tablemax] [-w weight] [-o out] file...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+/* Defaults: must stay in sync with the block layout in mm.c */
+#define DEF_CLASSES 20		/* total number of free lists (LISTLIMIT) */
+#define DEF_TABLE_MAX 16384 /* largest size covered by the lookup table */
+#define DEF_WEIGHT 1.0		/* mean block sizes of waste per unit list length */
+#define OVERHEAD 8			/* header + footer */
+#define MAXLINE 1024
+
+/* Block layouts mm.c can be built with: -DALIGNMENT and -m32 or not */
+static const struct
+{
+	int align; /* payload alignment */
+	int psize; /* pointer size: a free block holds two links */
+} layouts[] = {{8, 8}, {16, 8}, {8, 4}, {16, 4}};
+#define NUM_LAYOUTS (int)(sizeof(layouts) / sizeof(layouts[0]))
+
+/* Layout of the table being built: the alignment is also its granularity */
+static size_t unit;		 /* ALIGNMENT */
+static size_t min_block; /* MIN_BLOCK_SIZE: boundary tags plus links, aligned */
+
+static size_t align_up(size_t size)
+{
+	return (size + unit - 1) & ~(unit - 1);
+}
+
+/* Adjusted block size for a request, as computed by mm_malloc */
+static size_t adjust(size_t size)
+{
+	if (size <= min_block - OVERHEAD)
+		return min_block;
+	return align_up(size + OVERHEAD);
+}
+
+static int log2_ceil(size_t x)
+{
+	int n = 0;
+	while (((size_t)1 << n) < x)
+		n++;
+	return n;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: mkclasses [-n classes] [-m tablemax] [-w weight] "
+					"[-o outfile] tracefile...\n");
+	exit(1);
+}
+
+/*
+ * read_sizes - add the adjusted size of every alloc/realloc request in
+ *     one trace to the histogram. Sizes above the table are counted in
+ *     *overflow only.
+ */
+static void read_sizes(const char *path, double *hist, size_t table_max,
+					   double *overflow)
+{
+	FILE *fp;
+	char type[MAXLINE];
+	unsigned long index, size;
+	long header[4];
+
+	if ((fp = fopen(path, "r")) == NULL)
+	{
+		fprintf(stderr, "mkclasses: could not open %s: %s\n", path,
+				strerror(errno));
+		exit(1);
+	}
+	if (fscanf(fp, "%ld %ld %ld %ld", &header[0], &header[1], &header[2],
+			   &header[3]) != 4)
+	{
+		fprintf(stderr, "mkclasses: bad trace header in %s\n", path);
+		exit(1);
+	}
+	while (fscanf(fp, "%s", type) == 1)
+	{
+		switch (type[0])
+		{
+		case 'a':
+		case 's': /* alloc with a lifetime hint */
+		case 'l':
+		case 'r':
+			if (fscanf(fp, "%lu %lu", &index, &size) != 2)
+				break;
+			size = adjust(size);
+			if (size <= table_max)
+				hist[size / unit] += 1.0;
+			else
+				*overflow += 1.0;
+			break;
+		case 'f':
+			fscanf(fp, "%lu", &index);
+			break;
+		default:
+			fprintf(stderr, "mkclasses: bogus type character (%c) in %s\n",
+					type[0], path);
+			exit(1);
+		}
+	}
+	fclose(fp);
+}
+
+/*
+ * build_table - histogram the traces for the current layout and split
+ *     the table range into nprof classes. Fills upper[] with the class
+ *     upper bounds in units, smallest first, and returns the number of
+ *     requests in the table range (*overflow counts those above it).
+ */
+static double build_table(char **files, int nfiles, size_t table_max,
+						  int nprof, double weight, int *upper,
+						  double *overflow)
+{
+	int i, j, k;
+
+	/* Histogram of adjusted sizes in unit steps */
+	int nunits = table_max / unit;
+	double *hist = calloc(nunits + 1, sizeof(double));
+	*overflow = 0;
+	for (i = 0; i < nfiles; i++)
+		read_sizes(files[i], hist, table_max, overflow);
+
+	/* Distinct observed sizes (in units) with their counts */
+	int *sz = malloc((nunits + 1) * sizeof(int));
+	double *cnt = malloc((nunits + 1) * sizeof(double));
+	int m = 0;
+	double total = 0;
+	for (i = 0; i <= nunits; i++)
+		if (hist[i] > 0)
+		{
+			sz[m] = i;
+			cnt[m] = hist[i];
+			total += hist[i];
+			m++;
+		}
+	if (m == 0)
+	{
+		fprintf(stderr, "mkclasses: no requests in table range\n");
+		exit(1);
+	}
+
+	/* Prefix sums: P = sum of counts, Q = sum of count * size (bytes) */
+	double *P = calloc(m + 1, sizeof(double));
+	double *Q = calloc(m + 1, sizeof(double));
+	for (i = 0; i < m; i++)
+	{
+		P[i + 1] = P[i] + cnt[i];
+		Q[i + 1] = Q[i] + cnt[i] * sz[i] * unit;
+	}
+	double mean = Q[m] / total;
+#define COST(a, b) /* class holding observed sizes a..b-1 */        \
+	((double)sz[(b)-1] * unit * (P[b] - P[a]) - (Q[b] - Q[a]) + \
+	 weight * mean * (P[b] - P[a]) * (P[b] - P[a]) / total)
+
+	/*
+	 * best[k][j]: min cost of covering the first j observed sizes with
+	 * k classes; cut[k][j] remembers where the last class starts.
+	 */
+	int K = (nprof < m) ? nprof : m;
+	double *best = malloc((K + 1) * (m + 1) * sizeof(double));
+	int *cut = malloc((K + 1) * (m + 1) * sizeof(int));
+#define BEST(k, j) best[(k) * (m + 1) + (j)]
+#define CUT(k, j) cut[(k) * (m + 1) + (j)]
+	for (j = 0; j <= m; j++)
+		BEST(0, j) = (j == 0) ? 0 : 1e300;
+	for (k = 1; k <= K; k++)
+		for (j = 0; j <= m; j++)
+		{
+			BEST(k, j) = 1e300;
+			CUT(k, j) = 0;
+			for (i = k - 1; i < j; i++)
+			{
+				double v = BEST(k - 1, i) + COST(i, j);
+				if (v < BEST(k, j))
+				{
+					BEST(k, j) = v;
+					CUT(k, j) = i;
+				}
+			}
+		}
+
+	/* Recover class upper bounds (in units), smallest first */
+	j = m;
+	for (k = K; k >= 1; k--)
+	{
+		upper[k - 1] = sz[j - 1];
+		j = CUT(k, j);
+	}
+	upper[K - 1] = nunits; /* last profiled class reaches the table end */
+	/* Unused profiled classes (fewer distinct sizes than classes) stay empty */
+	for (k = K; k < nprof; k++)
+		upper[k] = nunits;
+
+	free(hist);
+	free(sz);
+	free(cnt);
+	free(P);
+	free(Q);
+	free(best);
+	free(cut);
+	return total;
+}
+
+/* emit_table - write the tables of the current layout */
+static void emit_table(FILE *out, const int *upper, int nprof,
+					   size_t table_max, double total, double overflow)
+{
+	int nunits = table_max / unit;
+	int i, k;
+
+	fprintf(out, "/* %.0f requests in the table range, %.0f above */\n",
+			total, overflow);
+	fprintf(out, "#define SC_UNIT_SHIFT %d\n\n", log2_ceil(unit));
+
+	fprintf(out, "/* Upper bound (bytes) of each profiled class */\n");
+	fprintf(out, "static const unsigned int sc_upper[%d] = {", nprof);
+	for (k = 0; k < nprof; k++)
+		fprintf(out, "%s%s%u", k ? "," : "", (k % 8) ? " " : "\n    ",
+				(unsigned)(upper[k] * unit));
+	fprintf(out, "};\n\n");
+
+	fprintf(out, "/* Class index for sizes 0..SC_TABLE_MAX, indexed by size / %d */\n",
+			(int)unit);
+	fprintf(out, "static const unsigned char sc_index[%d] = {", nunits + 1);
+	for (i = 0, k = 0; i <= nunits; i++)
+	{
+		while (k < nprof - 1 && i > upper[k])
+			k++;
+		fprintf(out, "%s%s%d", i ? "," : "", (i % 16) ? " " : "\n    ", k);
+	}
+	fprintf(out, "};\n\n");
+}
+
+int main(int argc, char **argv)
+{
+	int nclasses = DEF_CLASSES;
+	size_t table_max = DEF_TABLE_MAX;
+	double weight = DEF_WEIGHT;
+	char *outname = NULL;
+	FILE *out = stdout;
+	double total, overflow;
+	int c, i, l;
+
+	while ((c = getopt(argc, argv, "n:m:w:o:")) != EOF)
+	{
+		switch (c)
+		{
+		case 'n':
+			nclasses = atoi(optarg);
+			break;
+		case 'm':
+			table_max = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			weight = atof(optarg);
+			break;
+		case 'o':
+			outname = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind >= argc)
+		usage();
+	/* the largest layout needs room for at least two classes */
+	if (table_max < 64 || (table_max & (table_max - 1)) != 0)
+	{
+		fprintf(stderr, "mkclasses: table max must be a power of two >= 64\n");
+		exit(1);
+	}
+
+	/* Power-of-two tail classes: (2^t, 2^(t+1)] ... plus one catch-all */
+	int table_log = log2_ceil(table_max);
+	int ntail = (nclasses > 8) ? 6 : 1;
+	int nprof = nclasses - ntail;
+	if (nprof < 1)
+	{
+		fprintf(stderr, "mkclasses: need at least %d classes\n", ntail + 1);
+		exit(1);
+	}
+	int *upper = malloc(nprof * sizeof(int));
+
+	if (outname && (out = fopen(outname, "w")) == NULL)
+	{
+		fprintf(stderr, "mkclasses: could not open %s: %s\n", outname,
+				strerror(errno));
+		exit(1);
+	}
+
+	fprintf(out, "/*\n * sizeclass.h - generated by mkclasses from:\n");
+	for (i = optind; i < argc; i++)
+		fprintf(out, " *     %s\n", argv[i]);
+	fprintf(out, " *\n * %d profiled classes up to %lu bytes for each "
+				 "block layout,\n * list-length weight %.1f. Do not edit; "
+				 "run \"make classes\" to regenerate.\n */\n",
+			nprof, (unsigned long)table_max, weight);
+	fprintf(out, "#ifndef __SIZECLASS_H_\n#define __SIZECLASS_H_\n\n");
+	fprintf(out, "#define SC_NUM_CLASSES %d\n", nclasses);
+	fprintf(out, "#define SC_TABLE_MAX %lu\n", (unsigned long)table_max);
+	fprintf(out, "#define SC_TABLE_LOG %d\n", table_log);
+	fprintf(out, "#define SC_TAIL_BASE %d\n\n", nprof);
+
+	for (l = 0; l < NUM_LAYOUTS; l++)
+	{
+		unit = layouts[l].align;
+		min_block = align_up(OVERHEAD + 2 * layouts[l].psize);
+		total = build_table(argv + optind, argc - optind, table_max, nprof,
+							weight, upper, &overflow);
+		fprintf(out, "%s ALIGNMENT == %d && __SIZEOF_POINTER__ == %d\n",
+				l ? "#elif" : "#if", (int)unit, layouts[l].psize);
+		emit_table(out, upper, nprof, table_max, total, overflow);
+	}
+	fprintf(out, "#else\n#error \"no size-class table for this ALIGNMENT and pointer size\"\n"
+				 "#endif\n\n#endif /* __SIZECLASS_H_ */\n");
+
+	if (outname)
+		fclose(out);
+	free(upper);
+	return 0;
+}
@@ -2,34 +2,109 @@
 #include <stdlib.h>  // 표준 라이브러리 함수 (여기서는 직접 구현)
 #include <unistd.h>  // POSIX API (mem_sbrk 사용 위함)
 #include <string.h>  // 문자열/메모리 처리 함수 (memmove 사용 위함)
+#include <stdint.h>  // 크기 인덱스의 uint32_t 키
+#include <errno.h>   // 파일 힙을 열지 못한 이유 (EINVAL)
+#include <pthread.h> // 공유 힙의 프로세스 간 lock
+#include <time.h>    // 가용 페이지 반납 시각 (decay)
+#include <sched.h>   // worker 정지가 큐에 넣는 중인 스레드를 기다릴 때 (sched_yield)
+#include <sys/mman.h> // 크기 인덱스 배열은 힙 밖(mmap)에 둠
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // 크기 인덱스 SIMD 검색 (SSE4.1/AVX2)
+#define HAVE_X86_SIMD 1
+#endif
 #include "mm.h"     // 과제용 헤더 파일 (팀 정보 등)
+#include "mm_inline.h" // 인라인 빠른 경로가 쓰는 스레드별 quick list
 #include "memlib.h" // 메모리 시스템 시뮬레이션 라이브러리 (mem_sbrk 등 제공)
 
 // --- 기본 매크로 ---
 
-#define ALIGNMENT 8         // 메모리 정렬 기준 (8바이트 배수)
+#ifndef ALIGNMENT
+#define ALIGNMENT 8         // 메모리 정렬 기준 (8바이트 배수). Makefile에서 16으로 바꿀 수 있음
+#endif
+#if ALIGNMENT != 8 && ALIGNMENT != 16
+#error "ALIGNMENT must be 8 or 16"
+#endif
+#include "sizeclass.h" // mkclasses가 트레이스로부터 생성한 크기 클래스 테이블 (ALIGNMENT별로 하나씩)
 #define WSIZE 4             // 워드 크기 (4바이트)
-#define DSIZE 8             // 더블 워드 크기 (8바이트). 헤더, 푸터, 포인터 등의 기본 단위.
+#define DSIZE 8             // 더블 워드 크기 (8바이트). 헤더+푸터, 정렬의 기본 단위.
+#define PSIZE sizeof(void *) // 포인터 크기 (64비트 8, 32비트 4). 가용 블록 링크 하나의 크기
 #define CHUNKSIZE (1<<12)   // 초기 힙 크기 및 힙 확장 시 기본 증가량 (4KB)
-// 최소 블록 크기: 헤더(4)+푸터(4)+이전포인터(8)+다음포인터(8) = 24바이트
-#define MIN_BLOCK_SIZE (3 * DSIZE)
-#define LISTLIMIT 20        // 분리 가용 리스트의 개수
+// 최소 블록 크기: 헤더(4)+푸터(4)+이전/다음 포인터 = 64비트 24바이트, 32비트 16바이트 (16바이트 정렬이면 32)
+#define MIN_BLOCK_SIZE ALIGN(DSIZE + 2 * PSIZE)
+#define LISTLIMIT SC_NUM_CLASSES // 분리 가용 리스트의 개수 (sizeclass.h에서 결정, 기본 20)
+#define HOT_BINS 4          // 자주 요청되는 크기 전용 정확 크기(exact-fit) bin 개수 (top-K)
+#define SKETCH_SLOTS 16     // 요청 크기 빈도 추적용 sketch 슬롯 수 (HOT_BINS보다 커야 함)
+#define SKETCH_PERIOD 1024  // 몇 번의 malloc마다 hot bin을 다시 선정할지
+#define HOT_MIN_SHARE 16    // 한 주기 요청의 1/16 이상을 차지해야 hot 크기로 인정
+#define INDEX_INIT_CAP 512  // 크기 인덱스 배열의 처음 용량 (부족하면 두 배씩 늘림)
+#define META_CLASSES 48     // 공유 힙의 메타데이터 배열 크기 종류 (2^0 ~ 2^47 바이트)
+#ifndef DECAY_MS
+#define DECAY_MS 1000       // 가용 페이지를 이 시간(ms) 동안 안 쓰면 OS에 돌려줌 (mm_heap_set_decay로 변경)
+#endif
+#define DECAY_TICKS 64      // free 몇 번마다 한 번 시계를 보고 오래된 가용 페이지를 돌려줄지
+#define WORKER_WAKE_MS 10   // 백그라운드 worker가 깨어나는 주기 기본값 (ms)
+#define WORKER_QUEUE 4096   // 지연 free 큐 용량 기본값 (2의 거듭제곱)
+#define CACHE_LINE 64       // 캐시 라인 크기 (작은 블록이 라인 경계를 넘지 않게 배치할 때 기준)
+#ifndef MM_ENGINE
+#define MM_ENGINE MM_ENGINE_SEGLIST // 기본 엔진 (Makefile에서 ENGINE=1이면 버디 엔진)
+#endif
+#define COPY_INLINE_MAX 128 // realloc 복사에서 이 크기 이하는 인라인 복사
+#ifndef COPY_NT_MIN
+#define COPY_NT_MIN (256 * 1024) // 이 크기 이상은 non-temporal 저장 (mm_set_copy_threshold로 변경)
+#endif
+#ifndef TAIL_MIN
+#define TAIL_MIN 128        // 이 크기 이상의 블록은 가용 블록 뒤쪽에서 잘라 냄 (0이면 항상 앞쪽)
+#endif
+#ifndef LINE_PLACE
+#define LINE_PLACE 1        // 1이면 캐시 라인 인식 배치 사용 (Makefile에서 LINE_PLACE=0으로 끌 수 있음)
+#endif
 
 // --- 크기 및 할당 관련 매크로 ---
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y)) // 최대값 구하기
-// size를 ALIGNMENT(8)의 가장 가까운 배수로 올림 (비트 연산 활용)
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
+#define MIN(x, y) ((x) < (y) ? (x) : (y)) // 최소값 구하기
+// size를 ALIGNMENT의 가장 가까운 배수로 올림 (비트 연산 활용)
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
+// --- 큰 블록 크기 인코딩 ---
+// 헤더/푸터는 4바이트 그대로 두고, SMALL_MAX(4GB-ALIGNMENT) 이하는 지금처럼 크기를 그대로 저장.
+// 그보다 큰 블록은 LARGE_UNIT(4KB) 배수로만 만들고, LARGE_BIT를 켠 뒤 크기를 9비트 밀어서 저장
+// (4KB 배수라 하위 3비트는 항상 0 → 플래그 자리 유지). 표현 가능한 최대 크기는 약 2TB.
+#define LARGE_BIT 0x2
+#define LARGE_UNIT ((size_t)1 << 12)
+#define LARGE_SHIFT 9
+// (32비트 빌드는 size_t가 4바이트라 모든 크기가 작은 인코딩으로 들어감)
+#if SIZE_MAX > 0xffffffffu
+#define SMALL_MAX ((size_t)0x100000000 - ALIGNMENT)
+// 인코딩 가능한 최대 블록 크기
+#define MAX_BLOCK_SIZE (SMALL_MAX << LARGE_SHIFT)
+#else
+#define SMALL_MAX ((size_t)0 - ALIGNMENT)
+#define MAX_BLOCK_SIZE SMALL_MAX
+#endif
+// mm_inline.h의 빠른 경로는 헤더를 직접 읽으므로, 블록 형식이 바뀌면 여기서 빌드가 멈춰야 함
+_Static_assert(MM_QUICK_HUGE == LARGE_BIT, "mm_inline.h: huge-size bit differs from LARGE_BIT");
+_Static_assert(MM_QUICK_OVERHEAD == DSIZE, "mm_inline.h: block overhead differs from DSIZE");
+// size를 헤더 한 워드에 담을 수 있는지 (작은 크기이거나 4KB 배수)
+#define SIZE_FITS(size) ((size) <= SMALL_MAX || ((size) & (LARGE_UNIT - 1)) == 0)
 // 크기(size)와 할당 비트(alloc, 0 또는 1)를 합쳐 헤더/푸터 값 생성
-#define PACK(size, alloc) ((size) | (alloc))
+#define PACK(size, alloc) \
+    ((unsigned int)((size) <= SMALL_MAX ? (size) : (((size) >> LARGE_SHIFT) | LARGE_BIT)) | (alloc))
 // 주소 p에서 워드(4바이트) 읽기
 #define GET(p) (*(unsigned int *)(p))
 // 주소 p에 워드 val 쓰기
 #define PUT(p, val) (*(unsigned int *)(p) = (val))
-// 주소 p(헤더/푸터)에서 크기 정보 추출 (마지막 3비트는 0으로 만듦)
-#define GET_SIZE(p) (GET(p) & ~0x7)
+// 주소 p(헤더/푸터)에서 크기 정보 추출 (마지막 3비트는 0으로 만듦, 큰 블록이면 다시 9비트 복원)
+#define GET_SIZE(p) \
+    ((GET(p) & LARGE_BIT) ? (size_t)(GET(p) & ~0x7) << LARGE_SHIFT : (size_t)(GET(p) & ~0x7))
 // 주소 p(헤더/푸터)에서 할당 비트(맨 마지막 비트) 추출
 #define GET_ALLOC(p) (GET(p) & 0x1)
+// 할당 블록 헤더의 bit 2: nursery(단명 객체용 청크) 소속 블록. free/realloc이 이걸 보고 nursery로 보냄
+#define SHORT_TAG 0x4
+#define ALLOC_TAG(h) ((h)->parent != NULL ? SHORT_TAG : 0)
+// 할당 블록 푸터의 bit 2: 핸들 블록 (mm_compact가 옮길 수 있음). 푸터는 병합 때 할당 비트만 읽히므로
+// 헤더의 SHORT_TAG와 겹치지 않게 푸터에 둠. 핸들 블록 페이로드 맨 앞 HANDLE_PREFIX 바이트에는 핸들 번호.
+#define HANDLE_TAG 0x4
+#define HANDLE_PREFIX ALIGNMENT
 // 블록 포인터(bp, 페이로드 시작점)로부터 헤더 주소 계산
 #define HDRP(bp) ((char *)(bp) - WSIZE)
 // 블록 포인터(bp)로부터 푸터 주소 계산 (헤더에서 크기 읽어옴)
@@ -42,28 +117,250 @@
 // --- 가용 리스트 포인터 매크로 --- (명시적 리스트용)
 // 가용 블록 bp의 페이로드 시작 위치에 저장된 이전 가용 블록 포인터 값 읽기/쓰기
 #define PRED_PTR(bp) (*(void **)(bp))
-// 가용 블록 bp의 (페이로드 시작 + DSIZE) 위치에 저장된 다음 가용 블록 포인터 값 읽기/쓰기
-#define SUCC_PTR(bp) (*(void **)(bp + DSIZE))
+// 가용 블록 bp의 (페이로드 시작 + 포인터 하나) 위치에 저장된 다음 가용 블록 포인터 값 읽기/쓰기
+#define SUCC_PTR(bp) (*(void **)((char *)(bp) + PSIZE))
+
+// --- 크기 인덱스 매크로 --- (분리 리스트용)
+// 분리 리스트의 가용 블록은 연결 포인터 대신 인덱스 배열에서의 자기 위치(slot)를 페이로드 시작에 저장
+#define INDEX_SLOT(bp) (*(size_t *)(bp))
+#define NO_SLOT ((size_t)-1) // 인덱스 배열을 늘리지 못해 어디에도 등록되지 않은 블록
+// 인덱스 키: 8바이트 단위 크기. 32GB 이상은 UINT32_MAX로 포화 (이때만 헤더에서 실제 크기 확인)
+#define SIZE_KEY(size) \
+    ((size) >> 3 >= UINT32_MAX ? UINT32_MAX : (uint32_t)((size) >> 3))
+
+// --- decay 목록 매크로 ---
+// 한 페이지 이상을 품은 가용 블록은 링크(또는 인덱스 위치) 뒤에 decay 목록 링크와 들어온 시각을 둠.
+// 페이지를 돌려줄 때도 블록 앞 DECAY_HEAD 바이트와 푸터는 남기므로 경계 태그와 링크는 그대로임
+#define DECAY_PREV(bp) (*(char **)((char *)(bp) + 2 * PSIZE))
+#define DECAY_NEXT(bp) (*(char **)((char *)(bp) + 3 * PSIZE))
+#define DECAY_STAMP(bp) (*(uint64_t *)((char *)(bp) + 4 * PSIZE)) // ms 시각 + 1 (0이면 목록에 없음)
+#define DECAY_HEAD (4 * PSIZE + 8)
+
+// --- 크기 인덱스 ---
+// 크기 클래스 하나의 가용 블록들. 블록 크기(key)와 주소(blk)를 힙 밖의 연속 배열에
+// struct-of-arrays로 두어 find_fit이 흩어진 가용 블록을 따라가지 않고 key만 SIMD로 훑음.
+// 순서는 없음: 삽입은 맨 뒤에 추가, 삭제는 마지막 원소를 빈자리로 옮김.
+typedef struct {
+    uint32_t *key; // 블록 크기 (SIZE_KEY)
+    void **blk;    // 블록 포인터 (bp)
+    size_t n;      // 원소 수
+    size_t cap;    // 배열 용량
+} size_index_t;
+
+// --- 핸들 테이블 항목 ---
+// 핸들은 (항목 번호 + 1). 블록이 옮겨져도 항목의 bp만 고치면 되므로 핸들 값은 그대로 유지됨.
+typedef struct {
+    void *bp;            // 블록 포인터 (빈 항목이면 NULL)
+    unsigned int locks;  // mm_hlock 횟수. 0이 아니면 mm_compact가 옮기지 않음
+    unsigned int next;   // 빈 항목이면 다음 빈 항목 번호 + 1 (0이면 끝)
+} handle_entry_t;
+
+// --- 세그먼트 매크로 ---
+// 영역이 더 늘 수 없으면 memlib에서 떨어진 세그먼트를 받아 씀. 세그먼트마다
+// [영역 포인터 DSIZE][패딩 DSIZE][패딩 4][프롤로그 8][블록 ...][에필로그 4] 배치라 병합은 세그먼트 안에서 끝남
+#define SEG_HDR_SIZE (2 * DSIZE)
+// 세그먼트 첫 블록 bp로 그 세그먼트의 memlib 영역 찾기
+#define SEG_OF(bp) (*(mem_region_t **)((char *)(bp) - 4 * WSIZE - SEG_HDR_SIZE))
+
+// --- 버디 엔진 매크로 ---
+// 최소 블록: 헤더 자리 DSIZE + 가용 목록 링크 두 개 (64비트 32바이트, 32비트 16바이트)
+#define BUDDY_MIN_ORDER (DSIZE + 2 * PSIZE > 16 ? 5 : 4)
+#define BUDDY_MAX_ORDER 31  // 헤더 워드에 담을 수 있는 가장 큰 블록 (2GB)
+#define BUDDY_HDR ALIGNMENT // 페이로드 정렬을 지키는 헤더 크기
+// 가용 블록의 이전/다음 블록 (블록 시작 기준. 가용인 동안 헤더는 쓰지 않음)
+#define BUDDY_PREV(blk) (*(char **)((blk) + DSIZE))
+#define BUDDY_NEXT(blk) (*(char **)((blk) + DSIZE + PSIZE))
+
+// 버디 엔진 상태 (힙마다 하나. 기본 엔진의 가용 리스트처럼 힙의 lock 안에서만 씀)
+typedef struct {
+    char *base;                          // 힙 시작. 오프셋은 모두 여기서부터
+    size_t size;                         // 지금까지 덧붙인 바이트 수
+    char *free[BUDDY_MAX_ORDER + 1];     // 차수별 가용 블록 (이중 연결)
+    uint64_t avail;                      // bit k: free[k]가 비어 있지 않음
+    uint64_t *map;                       // 차수별 비트맵을 이어 붙인 것 (힙 밖 mmap)
+    size_t map_words;
+    size_t map_off[BUDDY_MAX_ORDER + 1]; // 차수 k 비트맵의 시작 워드
+} buddy_t;
+
+// --- 지연 free 큐 항목 ---
+// 여러 스레드가 lock 없이 넣고 worker(또는 lock을 쥔 스레드) 하나가 꺼내는 고정 크기 링 버퍼.
+// seq는 슬롯 차례 번호: pos이면 넣을 차례, pos + 1이면 꺼낼 차례
+typedef struct {
+    size_t seq;
+    void *ptr;
+} defer_slot_t;
+
+// --- 힙 객체 ---
+// 할당기의 모든 상태. 힙마다 자기 memlib 영역(region)과 가용 리스트를 따로 가짐.
+struct mm_heap {
+    mem_region_t *region; // 이 힙이 mem_sbrk 하는 메모리 영역
+    mem_region_t *seg_last; // 영역이 가득 찬 뒤 늘려 가는 세그먼트 (없으면 NULL)
+
+    // 수명 힌트용 nursery. MM_SHORT_LIVED 블록은 부모 힙에서 받은 청크 안에서만 할당되므로
+    // 오래 사는 블록 사이에 구멍을 남기지 않고, 청크가 비면 통째로 부모에게 돌려줌.
+    mm_heap_t *nursery; // 이 힙의 nursery (nursery 자신은 NULL)
+    mm_heap_t *parent;  // nursery의 부모 힙 (최상위 힙은 NULL)
+
+    // 엔진 (mm_set_engine). 힙을 만들 때(기본 힙은 mm_init 때) 정해지고, MM_ENGINE_BUDDY면 아래
+    // 분리 리스트 대신 buddy를 씀. 공유 힙과 파일 힙은 늘 분리 리스트
+    int engine;
+    buddy_t buddy;
+
+    // 분리 가용 리스트. 크기 클래스마다 가용 블록 크기 인덱스 하나.
+    size_index_t seg_index[LISTLIMIT];
+
+    // 설정 (mm_init_ex). 힙을 만들 때 현재 설정에서 복사해 두므로 설정이 바뀌어도
+    // 이미 리스트에 있는 블록의 클래스는 그대로 유지됨
+    size_t chunk;     // 힙 확장 기본 단위
+    size_t split_min; // 남는 부분이 이 크기 이상일 때만 분할
+    size_t tail_min;  // 이 크기 이상의 블록은 가용 블록 뒤쪽에 배치 (0이면 끔)
+    int classes;      // 쓰는 분리 리스트 수 (LISTLIMIT 이하)
+    int line_place;   // 1이면 캐시 라인 인식 배치
+    int hot_bins;     // 1이면 hot bin 사용
+
+    // 정확 크기 bin. hot_bin_size[i] 크기의 가용 블록만 hot_bin_lists[i]에 모임 (0이면 빈 슬롯)
+    size_t hot_bin_size[HOT_BINS];
+    void *hot_bin_lists[HOT_BINS];
+
+    // 요청 크기 sketch (Space-Saving 방식). 슬롯마다 크기와 대략적인 빈도를 기록
+    size_t sketch_size[SKETCH_SLOTS];
+    unsigned int sketch_count[SKETCH_SLOTS];
+    unsigned int sketch_ticks; // 마지막 hot bin 재선정 이후 malloc 횟수
+
+    // 핸들 테이블. 인덱스 배열처럼 힙 밖(mmap)에 두어 압축(compaction) 중에도 움직이지 않음
+    handle_entry_t *handles;
+    size_t handle_cap;  // 테이블 용량
+    size_t handle_used; // 한 번이라도 쓰인 항목 수
+    size_t handle_free; // 빈 항목 목록의 첫 번호 + 1 (0이면 없음)
+    char *first_bp;     // 프롤로그 바로 뒤 첫 블록 (mm_compact가 여기서부터 훑음)
+
+    // 파일 힙 (mm_heap_open). 힙 밖 배열도 공유 힙처럼 영역 꼭대기에 두므로 힙 객체, 인덱스,
+    // 핸들 테이블이 모두 파일에 남음. 닫을 때와 같은 주소로 다시 열리면 위의 포인터를 그대로 쓰고,
+    // 주소가 바뀌었거나 닫지 않고 끝났으면 경계 태그를 훑어 다시 만듦 (root는 영역 시작 기준 오프셋)
+    unsigned int magic; // HEAP_MAGIC이면 파일에 저장된 힙
+    size_t layout;      // HEAP_LAYOUT: 저장한 빌드와 블록 배치가 같은지 확인
+    size_t root;        // mm_heap_set_root로 등록한 블록 (0이면 없음)
+    int clean;          // 1이면 mm_heap_close로 닫힌 뒤 아직 열리지 않음 (파일의 포인터를 믿어도 됨)
+
+    // 공유 힙 (mm_heap_create_shared). 모든 프로세스가 영역을 같은 주소에 매핑하므로
+    // 블록 포인터와 가용 리스트 링크를 그대로 주고받을 수 있음. 힙 밖 배열도 영역 안에서 받음
+    int shared;                     // 1이면 공유 힙
+    int locking;                    // 1이면 공개 함수마다 lock을 잡음 (공유 힙, lock_user, worker 실행 중)
+    int lock_user;                  // 1이면 mm_heap_set_locking으로 켠 lock (worker와 무관하게 유지)
+    pthread_mutex_t lock;           // 재귀. 공유 힙이면 프로세스 간 공유 + robust
+    void *meta_cache[META_CLASSES]; // 반납된 메타데이터 배열 (2^i 바이트 크기별 목록)
+
+    // 가용 페이지 반납 (decay). 한 페이지 이상을 품은 가용 블록은 들어온 순서대로 decay 목록에
+    // 걸리고, decay_ms 동안 그대로 남아 있으면 안쪽 페이지를 madvise로 돌려줌. 돌려준 페이지는
+    // 비트맵에 표시해 두었다가 다시 할당될 때 새 페이지 폴트(refault)로 셈
+    size_t decay_min;          // 이 크기 이상의 가용 블록만 추적 (추적하지 않는 힙은 SIZE_MAX)
+    long decay_ms;             // 반납까지 기다릴 시간 (음수면 mm_heap_purge(h, 1)로만 반납)
+    char *decay_head;          // 가장 오래된 블록
+    char *decay_tail;          // 가장 최근 블록
+    unsigned int decay_ticks;  // 마지막으로 시계를 본 뒤의 free 횟수
+    char *purge_base;          // 비트맵 0번 비트의 페이지 주소
+    uint64_t *purge_map;       // 페이지마다 1비트: 반납되어 아직 다시 쓰이지 않음
+    size_t purge_map_words;    // 비트맵 크기 (64비트 워드 수)
+    mm_purge_stats_t purge_stats;
+
+    // 백그라운드 worker (mm_heap_start_worker). 실행 중에는 mm_heap_free가 블록을 큐에 넣기만 하고
+    // worker가 모아서 병합, 페이지 반납, hot bin 재선정을 함
+    int defer_on;              // 1이면 free를 큐로 보냄
+    int defer_users;           // defer_on을 보고 큐에 넣는 중인 스레드 수 (worker 정지가 0까지 기다림)
+    defer_slot_t *defer_slots; // 큐 (힙 밖 배열)
+    size_t defer_mask;         // 큐 용량 - 1
+    size_t defer_enq;          // 다음에 넣을 위치 (여러 스레드가 CAS로 증가)
+    size_t defer_deq;          // 다음에 꺼낼 위치 (lock을 쥔 쪽만 씀)
+    size_t defer_batch;        // 이만큼 쌓일 때마다 worker를 깨움
+    long wake_ms;              // worker가 깨어나는 주기
+    int worker_stop;           // 1이면 worker 종료
+    pthread_t worker;
+    pthread_mutex_t worker_mx; // worker_cv용
+    pthread_cond_t worker_cv;  // 주기 대기 / 조기 깨움
+};
+
+// 힙 영역 맨 앞의 힙 객체 + nursery 자리 (정렬 유지). 프롤로그는 그 바로 뒤
+#define HEAP_HDR_SIZE ((2 * sizeof(mm_heap_t) + 2 * DSIZE - 1) & ~(size_t)(2 * DSIZE - 1))
+#define HEAP_MAGIC 0x6d6d6870 // "mmhp"
+#define HEAP_LAYOUT ((sizeof(mm_heap_t) << 8) | (LISTLIMIT << 5) | ALIGNMENT)
+// 공유 힙, lock을 켠 힙, worker가 도는 힙만 lock을 잡음 (다른 힙은 분기 하나).
+// lock을 잡지 못하면(복구할 수 없게 된 공유 힙) 부른 함수가 fail을 반환함 (void 함수는 빈 인자)
+#define HEAP_LOCK(h, fail) do { if ((h)->locking && heap_lock(h) < 0) return fail; } while (0)
+#define HEAP_UNLOCK(h) do { if ((h)->locking) pthread_mutex_unlock(&(h)->lock); } while (0)
 
 // --- 전역 변수 ---
-// 분리 가용 리스트 배열. 각 배열 요소는 해당 크기 클래스의 가용 리스트 시작점(헤드)을 가리킴.
-void *segregated_free_lists[LISTLIMIT];
+// 기본 힙. mm_init/mm_malloc/mm_free/mm_realloc은 이 힙을 사용 (memlib의 기본 영역 위에 생성)
+static mm_heap_t default_heap;
+static mm_heap_t default_nursery; // 기본 힙의 nursery
+// 현재 설정 (mm_init_ex, MM_CONF, mm_set_engine 등). MM_CONF는 처음 쓸 때 한 번 읽음 (conf_load)
+static mm_config_t conf = {
+    CHUNKSIZE, LISTLIMIT, MIN_BLOCK_SIZE, TAIL_MIN, 0, 0, MM_ENGINE, LINE_PLACE, 1, DECAY_MS, COPY_NT_MIN
+};
+static int conf_loaded;
+// 스레드별 quick list (mm_inline.h). 기본 힙에서 할당된 작은 블록을 할당 상태 그대로 모아 둠
+__thread mm_quick_t mm_quick;
 
 // --- 함수 프로토타입 ---
 // (주요 함수들의 선언. 실제 정의는 아래에 나옴)
-static void *extend_heap(size_t words);
-static int get_list_index(size_t size);
-static void insert_node(void *bp, size_t size);
-static void delete_node(void *bp);
-static void *coalesce(void *bp);
-static void *coalesce_case1(void *bp, size_t size);
-static void *coalesce_case2(void *bp, size_t size, void* next_bp, size_t next_size);
-static void *coalesce_case3(void *bp, size_t size, void* prev_bp, size_t prev_size);
-static void *coalesce_case4(void *bp, size_t size, void* prev_bp, size_t prev_size, void* next_bp, size_t next_size);
-static void *find_fit(size_t asize);
-static void place(void *bp, size_t asize);
-static void *mm_realloc_inplace(void *ptr, size_t oldsize, size_t newsize);
-static void *mm_realloc_copy(void *ptr, size_t oldsize, size_t size);
+static void conf_load(void);
+static int heap_init(mm_heap_t *h);
+static int heap_recover(mm_heap_t *h);
+static int heap_rebuild(mm_heap_t *h);
+static int heap_ends_ok(mm_heap_t *h);
+static int handle_reserve(mm_heap_t *h, size_t cap);
+static void release_index(mm_heap_t *h);
+static handle_entry_t *handle_entry(mm_heap_t *h, mm_handle_t handle);
+static void *extend_heap(mm_heap_t *h, size_t words);
+static void *grow_region(mm_heap_t *h, mem_region_t *r, size_t size);
+static void *segment_create(mm_heap_t *h, size_t size);
+static void segment_release(mm_heap_t *h, void *bp);
+static int get_list_index(mm_heap_t *h, size_t size);
+static void **hot_bin_head(mm_heap_t *h, size_t size);
+static int heap_lock(mm_heap_t *h);
+static void lock_update(mm_heap_t *h);
+static void *heap_malloc(mm_heap_t *h, size_t size);
+static void heap_free(mm_heap_t *h, void *bp);
+static void *heap_realloc(mm_heap_t *h, void *ptr, size_t size);
+static void *heap_memalign(mm_heap_t *h, size_t align, size_t size);
+static mm_handle_t heap_halloc(mm_heap_t *h, size_t size);
+static size_t heap_compact(mm_heap_t *h);
+static void *meta_alloc(mm_heap_t *h, size_t bytes);
+static uint64_t decay_now(void);
+static void decay_insert(mm_heap_t *h, char *bp);
+static void decay_delete(mm_heap_t *h, char *bp);
+static size_t decay_purge(mm_heap_t *h, int all);
+static size_t purge_span(mm_heap_t *h, char *lo, char *hi);
+static void purge_touch(mm_heap_t *h, char *lo, char *hi, int reuse);
+static void meta_release(mm_heap_t *h, void *p, size_t bytes);
+static int defer_push(mm_heap_t *h, void *ptr);
+static size_t defer_drain(mm_heap_t *h, int discard);
+static void *worker_main(void *arg);
+static void defer_teardown(mm_heap_t *h);
+static int index_grow(mm_heap_t *h, size_index_t *ix);
+static void index_insert(mm_heap_t *h, size_index_t *ix, void *bp, size_t size);
+static void index_delete(size_index_t *ix, size_t slot);
+static size_t index_search(const uint32_t *key, size_t n, uint32_t target);
+static void sketch_record(mm_heap_t *h, size_t asize);
+static void update_hot_bins(mm_heap_t *h);
+static void insert_node(mm_heap_t *h, void *bp, size_t size);
+static void list_insert(mm_heap_t *h, void *bp, size_t size);
+static void delete_node(mm_heap_t *h, void *bp);
+static void *coalesce(mm_heap_t *h, void *bp);
+static void *make_free_block(mm_heap_t *h, void *bp, size_t size);
+static void *coalesce_case1(mm_heap_t *h, void *bp, size_t size);
+static void *coalesce_case2(mm_heap_t *h, void *bp, size_t size, void* next_bp, size_t next_size);
+static void *coalesce_case3(mm_heap_t *h, size_t size, void* prev_bp, size_t prev_size);
+static void *coalesce_case4(mm_heap_t *h, size_t size, void* prev_bp, size_t prev_size, void* next_bp, size_t next_size);
+static size_t adjust_size(size_t size);
+static void *find_fit(mm_heap_t *h, size_t asize);
+static size_t line_lead(void *bp, size_t csize, size_t asize);
+static void *place(mm_heap_t *h, void *bp, size_t asize);
+static void *mm_realloc_inplace(mm_heap_t *h, void *ptr, size_t oldsize, size_t newsize);
+static void *mm_realloc_copy(mm_heap_t *h, void *ptr, size_t oldsize, size_t size);
+static int buddy_init(mm_heap_t *h);
+static void *buddy_malloc(mm_heap_t *h, size_t size);
+static void buddy_free(mm_heap_t *h, void *ptr);
+static void *buddy_realloc(mm_heap_t *h, void *ptr, size_t size);
 
 // --- 팀 정보 --- (과제 제출용 정보)
 team_t team = {
@@ -75,16 +372,359 @@ team_t team = {
 };
 
 // --- 메모리 시스템 초기화 ---
+// 기본 힙을 memlib 기본 영역 위에 (다시) 만듦
 int mm_init(void) {
+    int ret;
+
+    conf_load();
+    memset(&mm_quick, 0, sizeof(mm_quick)); // quick list의 블록은 힙과 함께 사라짐
+    if (conf.engine == MM_ENGINE_BUDDY && default_heap.defer_slots != NULL) {
+        errno = EINVAL; // worker는 분리 리스트 블록만 다룸
+        return -1;
+    }
+    HEAP_LOCK(&default_heap, -1); // worker가 돌고 있으면 그동안 멈춰 있게 함
+    default_heap.region = mem_default_region();
+    default_heap.nursery = &default_nursery;
+    default_nursery.parent = &default_heap;
+    if ((default_heap.engine = conf.engine) == MM_ENGINE_BUDDY) {
+        ret = buddy_init(&default_heap);
+        HEAP_UNLOCK(&default_heap);
+        return ret;
+    }
+    ret = heap_init(&default_heap);
+    // 처음부터 reserve만큼 가용 공간을 잡아 둠 (첫 청크와 병합됨). 영역에 남은 만큼까지만
+    if (ret == 0 && conf.reserve > default_heap.chunk) {
+        size_t more = MIN(conf.reserve - default_heap.chunk, mem_region_room(default_heap.region));
+        if (more >= MIN_BLOCK_SIZE && extend_heap(&default_heap, more / WSIZE) == NULL) {
+            ret = -1;
+        }
+    }
+    HEAP_UNLOCK(&default_heap);
+    return ret;
+}
+
+// --- 힙 생성 ---
+// max_size: 이 힙이 커질 수 있는 최대 크기. 자기 전용 memlib 영역을 만들고
+// 힙 객체 자체도 그 영역 맨 앞에 둠 (그래서 mm_heap_destroy 한 번으로 전부 정리됨)
+mm_heap_t *mm_heap_create(size_t max_size) {
+    size_t hsize = HEAP_HDR_SIZE; // 힙 + nursery
+    mem_region_t *region = mem_region_create(hsize + max_size);
+    mm_heap_t *h;
+
+    if (region == NULL) {
+        return NULL;
+    }
+    if ((h = mem_region_sbrk(region, hsize)) == (void *)-1) {
+        mem_region_destroy(region);
+        return NULL;
+    }
+    h->region = region;
+    h->nursery = h + 1; // 영역은 0으로 채워져 있으므로 나머지 필드는 비어 있음
+    h->nursery->parent = h;
+    conf_load();
+    h->engine = conf.engine;
+    if ((h->engine == MM_ENGINE_BUDDY ? buddy_init(h) : heap_init(h)) < 0) {
+        mem_region_destroy(region);
+        return NULL;
+    }
+    return h;
+}
+
+// --- 공유 힙 생성 ---
+// 여러 프로세스가 함께 쓰는 힙. name이 NULL이면 fork로 물려받는 익명 공유 매핑, 아니면
+// POSIX 공유 메모리 객체 name을 만들어 다른 프로세스가 mm_heap_attach로 붙을 수 있게 함.
+// 한 프로세스에서 할당한 블록을 다른 프로세스에서 해제해도 됨 (포인터 그대로 전달)
+mm_heap_t *mm_heap_create_shared(const char *name, size_t max_size) {
+    size_t hsize = HEAP_HDR_SIZE;
+    mem_region_t *region = mem_region_create_shared(name, hsize + max_size);
+    pthread_mutexattr_t attr;
+    mm_heap_t *h;
+
+    if (region == NULL) {
+        return NULL;
+    }
+    if ((h = mem_region_sbrk(region, hsize)) == (void *)-1) {
+        goto fail;
+    }
+    h->region = region;
+    h->shared = 1;
+    h->locking = 1;
+    h->layout = HEAP_LAYOUT;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    if (pthread_mutex_init(&h->lock, &attr) != 0) {
+        pthread_mutexattr_destroy(&attr);
+        goto fail;
+    }
+    pthread_mutexattr_destroy(&attr);
+    if (heap_init(h) < 0) {
+        goto fail;
+    }
+    h->magic = HEAP_MAGIC; // 초기화가 끝난 뒤에야 mm_heap_attach가 받아 줌
+    return h;
+
+fail:
+    mem_region_destroy(region);
+    if (name != NULL) {
+        mem_region_unlink(name);
+    }
+    return NULL;
+}
+
+// --- 공유 힙 붙기 ---
+// mm_heap_create_shared(name, ...)로 만든 힙을 이 프로세스에 만든 쪽과 같은 주소로 매핑.
+// 그 주소가 이미 쓰이고 있으면 NULL (EADDRINUSE)
+mm_heap_t *mm_heap_attach(const char *name) {
+    mem_region_t *region = mem_region_attach(name);
+    mm_heap_t *h;
+
+    if (region == NULL) {
+        return NULL;
+    }
+    h = mem_region_lo(region);
+    if (mem_region_heapsize(region) < HEAP_HDR_SIZE ||
+        h->magic != HEAP_MAGIC || h->layout != HEAP_LAYOUT || !h->shared) {
+        mem_region_destroy(region);
+        errno = EINVAL;
+        return NULL;
+    }
+    return h;
+}
+
+// --- 공유 메모리 객체 이름 제거 ---
+// 이미 붙은 프로세스는 mm_heap_destroy로 떨어질 때까지 계속 쓸 수 있음
+int mm_heap_unlink(const char *name) {
+    return mem_region_unlink(name);
+}
+
+// --- 힙 비우기 ---
+// mm_heap_create로 만든 힙의 블록을 모두 없애고 빈 힙으로 다시 시작 (기본 힙의 mm_init과 같음).
+// 영역의 페이지는 매핑된 채로 남아 다음 할당이 그대로 씀. 공유/파일 힙과 worker가 도는 힙은 EINVAL
+int mm_heap_reset(mm_heap_t *h) {
+    if (h->shared || h->magic != 0 || h->parent != NULL || h == &default_heap || h->defer_slots != NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    mem_region_reset_brk(h->region);
+    if (mem_region_sbrk(h->region, HEAP_HDR_SIZE) == (void *)-1) { // 힙 + nursery 자리는 그대로 둠
+        return -1;
+    }
+    return (h->engine == MM_ENGINE_BUDDY) ? buddy_init(h) : heap_init(h);
+}
+
+// --- 힙 제거 ---
+// 힙의 모든 블록을 한꺼번에 해제 (개별 free 불필요).
+// 공유 힙이면 이 프로세스의 매핑만 풂 (다른 프로세스는 계속 씀)
+void mm_heap_destroy(mm_heap_t *h) {
+    if (h->shared) {
+        mem_region_destroy(h->region);
+        return;
+    }
+    mm_heap_stop_worker(h); // 큐에 남은 블록은 어차피 모두 사라지지만 스레드는 거둬야 함
+    if (h != &default_heap) { // 기본 힙은 비우기만 하므로 lock 설정을 그대로 둠
+        h->lock_user = 0;
+        lock_update(h);
+    }
+    if (h->magic != 0) { // 파일 힙: 인덱스와 핸들 테이블은 다음에 열 때 쓰도록 파일에 그대로 둠
+        mem_region_destroy(h->region);
+        return;
+    }
+    release_index(h); // 힙 밖에 있는 인덱스 배열 먼저 반납
+    if (h->nursery != NULL) {
+        release_index(h->nursery);
+    }
+    if (h->handle_cap != 0) {
+        meta_release(h, h->handles, h->handle_cap * sizeof(handle_entry_t));
+        h->handles = NULL;
+        h->handle_cap = 0;
+    }
+    if (h == &default_heap) { // 기본 영역은 memlib 소유이므로 비우기만 함 (버디 비트맵은 다음에 다시 씀)
+        mem_region_reset_brk(h->region);
+        if (h->engine == MM_ENGINE_BUDDY) {
+            buddy_init(h);
+        } else {
+            heap_init(h);
+        }
+        return;
+    }
+    if (h->buddy.map != NULL) {
+        munmap(h->buddy.map, h->buddy.map_words * sizeof(uint64_t));
+    }
+    mem_region_destroy(h->region);
+}
+
+// --- 파일 힙 열기 ---
+// path 파일을 힙 영역으로 매핑. 새 파일이면 빈 힙을 만들고, 이미 힙이 있으면 바로 이어서 씀.
+// mm_heap_close로 닫혔고 같은 주소에 다시 매핑되면 파일의 인덱스와 핸들 테이블을 그대로 쓰므로
+// 블록을 하나도 훑지 않음 (건드리는 페이지만큼의 비용). 그렇지 않으면 블록을 모두 훑어 검사하면서
+// 다시 만듦. 블록 내용은 건드리지 않으므로 객체를 다시 만들 필요가 없음. 파일이 힙이 아니거나 깨졌으면 NULL
+mm_heap_t *mm_heap_open(const char *path, size_t max_size) {
+    size_t hsize = HEAP_HDR_SIZE;
+    mem_region_t *region;
+    mm_heap_t *h;
+    int existed;
+
+    if ((region = mem_region_open(path, hsize + max_size, &existed)) == NULL) {
+        return NULL;
+    }
+
+    // 1. 새 파일: mm_heap_create와 같은 배치 (nursery 자리는 비워 둠)
+    if (!existed) {
+        if ((h = mem_region_sbrk(region, hsize)) == (void *)-1) {
+            mem_region_destroy(region);
+            return NULL;
+        }
+        h->region = region;
+        h->magic = HEAP_MAGIC;
+        h->layout = HEAP_LAYOUT;
+        if (heap_init(h) < 0) {
+            mem_region_destroy(region);
+            return NULL;
+        }
+        return h;
+    }
+
+    // 2. 기존 힙: 이 프로세스에서만 의미가 있는 상태(lock, worker, nursery)는 비움
+    h = mem_region_lo(region);
+    if (mem_region_heapsize(region) < hsize + 4 * WSIZE ||
+        h->magic != HEAP_MAGIC || h->layout != HEAP_LAYOUT || h->shared) {
+        mem_region_destroy(region);
+        errno = EINVAL;
+        return NULL;
+    }
+    h->nursery = NULL; // 청크를 구별할 표시가 없으므로 파일 힙은 nursery 없이 씀
+    h->parent = NULL;
+    h->seg_last = NULL;
+    h->decay_head = h->decay_tail = NULL; // 파일 힙은 decay를 쓰지 않음 (decay_min = SIZE_MAX)
+    h->purge_map = NULL;
+    h->purge_map_words = 0;
+    h->locking = h->lock_user = 0; // lock은 이 프로세스에서 다시 켜야 함
+    h->defer_on = h->defer_users = 0; // 닫을 때 worker를 멈췄으므로 큐도 비어 있음
+    h->defer_slots = NULL;
+
+    // 3. 닫을 때와 같은 주소(영역 객체 주소가 같음)면 파일의 인덱스와 핸들 테이블을 그대로 씀:
+    //    블록을 훑지 않고 프롤로그와 에필로그만 확인. 아니면 배열을 버리고 heap_recover로 다시 만듦
+    if (!(h->clean && h->region == region && heap_ends_ok(h))) {
+        h->region = region;
+        if (heap_rebuild(h) < 0) {
+            mem_region_destroy(region); // 파일은 그대로 둠
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+
+    // 4. 다시 닫기 전에 끝나면 다음 열기가 훑도록 표시를 지우고 바로 파일에 씀
+    h->clean = 0;
+    if (mm_heap_sync(h) < 0) {
+        mem_region_destroy(region);
+        return NULL;
+    }
+    return h;
+}
+
+// --- 파일 힙 저장 ---
+// 지금까지의 변경을 파일에 씀 (스냅샷). 익명 메모리 힙이면 아무것도 안 함
+int mm_heap_sync(mm_heap_t *h) {
+    return mem_region_sync(h->region);
+}
+
+// --- 파일 힙 닫기 ---
+// 저장한 뒤 매핑을 풂. 블록은 파일에 남아 있어 mm_heap_open으로 다시 열 수 있음
+int mm_heap_close(mm_heap_t *h) {
+    int ret;
+
+    mm_heap_stop_worker(h); // 큐에 남은 free까지 반영한 뒤 저장
+    if (h->magic != 0) {
+        h->clean = 1; // 다음 mm_heap_open이 같은 주소면 훑지 않고 이어서 씀
+    }
+    ret = mm_heap_sync(h);
+
+    mm_heap_destroy(h);
+    return ret;
+}
+
+// --- 루트 블록 ---
+// 다시 열었을 때 객체를 찾아갈 시작점. 매핑 주소가 바뀌어도 되도록 오프셋으로 저장
+void mm_heap_set_root(mm_heap_t *h, void *ptr) {
+    h->root = (ptr == NULL) ? 0 : (size_t)((char *)ptr - (char *)mem_region_lo(h->region));
+}
+
+void *mm_heap_root(mm_heap_t *h) {
+    return (h->root == 0) ? NULL : (char *)mem_region_lo(h->region) + h->root;
+}
+
+// --- 인덱스 배열 반납 ---
+static void release_index(mm_heap_t *h) {
+    for (int i = 0; i < LISTLIMIT; i++) {
+        size_index_t *ix = &h->seg_index[i];
+        if (ix->cap != 0) {
+            meta_release(h, ix->blk, ix->cap * (sizeof(void *) + sizeof(uint32_t)));
+        }
+        ix->key = NULL;
+        ix->blk = NULL;
+        ix->n = ix->cap = 0;
+    }
+}
+
+// --- 힙 초기화 ---
+// 가용 리스트를 비우고 프롤로그/에필로그와 첫 가용 블록을 만듦
+// (nursery는 리스트만 비움. 청크는 처음 할당할 때 부모 힙에서 받아 옴)
+static int heap_init(mm_heap_t *h) {
     char *heap_listp; // 힙 시작 주소
 
-    // 1. 모든 분리 가용 리스트를 NULL로 초기화
+    // 1. 모든 분리 가용 리스트를 비우고 현재 설정을 가져옴 (인덱스 배열은 이전 실행의 것을 재사용)
     for (int i = 0; i < LISTLIMIT; i++) {
-        segregated_free_lists[i] = NULL;
+        h->seg_index[i].n = 0;
+    }
+    conf_load();
+    h->chunk = conf.chunk_size;
+    h->split_min = conf.split_min;
+    h->tail_min = conf.tail_min;
+    h->classes = (int)conf.classes;
+    h->line_place = conf.line_place;
+    h->hot_bins = conf.hot_bins;
+    // hot bin과 sketch도 비움 (트레이스마다 크기 분포가 다르므로)
+    for (int i = 0; i < HOT_BINS; i++) {
+        h->hot_bin_size[i] = 0;
+        h->hot_bin_lists[i] = NULL;
+    }
+    for (int i = 0; i < SKETCH_SLOTS; i++) {
+        h->sketch_size[i] = 0;
+        h->sketch_count[i] = 0;
+    }
+    h->sketch_ticks = 0;
+    h->seg_last = NULL; // 세그먼트는 영역을 비울 때(mem_region_reset_brk) memlib이 함께 거둠
+    if (h->defer_slots != NULL) {
+        defer_drain(h, 1); // 큐에 남은 free는 이전 힙의 블록이므로 버림
+    }
+    h->handle_used = 0; // 블록이 모두 사라졌으므로 핸들도 모두 무효 (테이블은 재사용)
+    h->handle_free = 0;
+
+    // decay: 익명 메모리 위의 최상위 힙만 페이지를 돌려줌. 파일 힙(이미 magic이 있음)과
+    // 공유 힙은 madvise로 메모리가 줄지 않고, nursery 청크는 부모 힙에서 할당된 블록임
+    h->decay_head = h->decay_tail = NULL;
+    h->decay_ticks = 0;
+    h->decay_ms = conf.decay_ms;
+    h->decay_min = SIZE_MAX;
+    if (h->parent == NULL && h->magic == 0 && !h->shared) {
+        h->decay_min = mem_pagesize() + DECAY_HEAD + DSIZE;
+    }
+    if (h->purge_map != NULL) {
+        memset(h->purge_map, 0, h->purge_map_words * sizeof(uint64_t));
+    }
+    memset(&h->purge_stats, 0, sizeof(h->purge_stats));
+    if (h->parent != NULL) {
+        return 0;
+    }
+    h->purge_base = (char *)((uintptr_t)mem_region_lo(h->region) & ~(uintptr_t)(mem_pagesize() - 1));
+    if (h->nursery != NULL && heap_init(h->nursery) < 0) {
+        return -1;
     }
 
     // 2. 힙의 맨 처음에 작은 공간(16바이트) 요청 (패딩 + 프롤로그 + 에필로그용)
-    if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1) {
+    if ((heap_listp = mem_region_sbrk(h->region, 4 * WSIZE)) == (void *)-1) {
         return -1; // 메모리 부족 시 실패
     }
 
@@ -94,187 +734,1785 @@ int mm_init(void) {
     PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1)); // [8] 프롤로그 푸터 (크기 8, 할당됨)
     PUT(heap_listp + (3 * WSIZE), PACK(0, 1));     // [12] 에필로그 헤더 (크기 0, 할당됨) - 힙의 끝 표시
     // 프롤로그 블록: 힙의 시작 부분 경계 역할. 병합 시 가장자리 처리 간편화.
+    h->first_bp = heap_listp + (4 * WSIZE);
+    // 첫 블록의 bp는 heap_listp + 16 이므로, 블록 크기가 모두 ALIGNMENT 배수이면
+    // 16바이트 정렬 모드에서도 추가 패딩 워드 없이 모든 페이로드가 16바이트 경계에 놓임.
+
+    // 4. 초기 가용 공간 확보를 위해 힙 확장 (청크 하나만큼)
+    if (extend_heap(h, h->chunk / WSIZE) == NULL) {
+        return -1; // 힙 확장 실패 시
+    }
+    return 0; // 초기화 성공
+}
+
+// --- 파일 힙 양 끝 확인 ---
+// 첫 블록 앞에 프롤로그가, brk 바로 앞에 에필로그가 있으면 1
+static int heap_ends_ok(mm_heap_t *h) {
+    char *bp = (char *)mem_region_lo(h->region) + HEAP_HDR_SIZE + (4 * WSIZE);
+    char *end = (char *)mem_region_hi(h->region) + 1;
+
+    return h->first_bp == bp && GET(HDRP(bp) - DSIZE) == PACK(DSIZE, 1) &&
+           GET(HDRP(bp) - WSIZE) == PACK(DSIZE, 1) && GET(end - WSIZE) == PACK(0, 1);
+}
+
+// --- 힙 복구 ---
+// 다시 연 파일 힙(또는 lock을 쥔 프로세스가 죽은 공유 힙)을 처음부터 훑으며 블록 배치를 검사하고,
+// 가용 블록은 인덱스에, 핸들 블록은 핸들 테이블에 다시 등록함. 붙어 있는 가용 블록은
+// (해제 도중 병합 전에 멈춘 것이므로) 하나로 합쳐 넣고, 에필로그가 brk보다 앞에 있으면
+// (힙을 늘리던 도중 멈춘 것이므로) 그 뒤 brk까지를 가용 블록으로 만듦.
+// 프롤로그가 없거나, 블록이 영역을 벗어나거나, 헤더와 푸터가 다르면 -1
+static int heap_recover(mm_heap_t *h) {
+    char *end = (char *)mem_region_hi(h->region) + 1;
+    char *bp = (char *)mem_region_lo(h->region) + HEAP_HDR_SIZE + (4 * WSIZE);
+    char *run = NULL; // 아직 인덱스에 넣지 않은 가용 블록들의 시작
+    size_t size;
+
+    h->first_bp = bp;
+    if (end - bp < DSIZE || GET(HDRP(bp) - DSIZE) != PACK(DSIZE, 1) || GET(HDRP(bp) - WSIZE) != PACK(DSIZE, 1)) {
+        return -1;
+    }
+    for (; (size = GET_SIZE(HDRP(bp))) != 0; bp += size) {
+        if (size < MIN_BLOCK_SIZE || (size & (ALIGNMENT - 1)) || size > (size_t)(end - bp) ||
+            GET_SIZE(FTRP(bp)) != size || GET_ALLOC(FTRP(bp)) != GET_ALLOC(HDRP(bp))) {
+            return -1;
+        }
+        if (!GET_ALLOC(HDRP(bp))) {
+            if (run == NULL) {
+                run = bp;
+            }
+            continue;
+        }
+        if (run != NULL) {
+            make_free_block(h, run, bp - run);
+            run = NULL;
+        }
+        if (GET(FTRP(bp)) & HANDLE_TAG) { // 핸들 번호는 블록 안에 있으므로 테이블을 그대로 되살림
+            size_t id = *(size_t *)bp;
+            if (id >= mem_region_heapsize(h->region) / MIN_BLOCK_SIZE ||
+                handle_reserve(h, id + 1) < 0 || h->handles[id].bp != NULL) {
+                return -1;
+            }
+            h->handles[id].bp = bp;
+            if (id >= h->handle_used) {
+                h->handle_used = id + 1;
+            }
+        }
+    }
+    if (GET(HDRP(bp)) != PACK(0, 1)) {
+        return -1; // 에필로그가 아닌 곳에서 끝남
+    }
+    if (HDRP(bp) != end - WSIZE) {
+        size = end - bp; // 늘린 부분을 가용 블록으로: 헤더는 옛 에필로그 자리, 새 에필로그는 brk 앞
+        if (size < MIN_BLOCK_SIZE || (size & (ALIGNMENT - 1))) {
+            return -1;
+        }
+        PUT(end - WSIZE, PACK(0, 1));
+        if (run == NULL) {
+            run = bp;
+        }
+        bp = end;
+    }
+    if (run != NULL) {
+        make_free_block(h, run, bp - run);
+    }
+
+    // 블록이 없는 핸들 번호는 빈 항목 목록으로
+    for (size_t id = h->handle_used; id-- > 0;) {
+        if (h->handles[id].bp == NULL) {
+            h->handles[id].next = h->handle_free;
+            h->handle_free = id + 1;
+        }
+    }
+    return 0;
+}
+
+// --- 힙 다시 만들기 ---
+// 영역 꼭대기에 둔 배열(인덱스, 핸들 테이블)과 hot bin을 버리고 heap_recover로 블록을 훑어 다시 만듦.
+// 배열을 영역 안에 두는 파일 힙과 공유 힙에서만 씀
+static int heap_rebuild(mm_heap_t *h) {
+    mem_region_release_top(h->region); // 이전 배열 자리를 비움
+    memset(h->meta_cache, 0, sizeof(h->meta_cache));
+    memset(h->seg_index, 0, sizeof(h->seg_index));
+    memset(h->hot_bin_size, 0, sizeof(h->hot_bin_size));
+    memset(h->hot_bin_lists, 0, sizeof(h->hot_bin_lists));
+    h->handles = NULL;
+    h->handle_cap = h->handle_used = h->handle_free = 0;
+    return heap_recover(h);
+}
+
+// --- 힙 확장 ---
+// words: 확장할 크기 (워드 단위)
+static void *extend_heap(mm_heap_t *h, size_t words) {
+    char *bp;      // 새로 확장된 영역의 블록 포인터
+    size_t size;   // 실제 확장할 바이트 크기 (정렬됨)
+
+    // 1. 요청 크기(words)를 바이트 단위로 바꾸고 ALIGNMENT 배수로 올림 (블록 크기 정렬 유지)
+    size = ALIGN(words * WSIZE);
+
+    // nursery는 부모 힙에서 청크 하나를 받아 그 안을 작은 힙처럼 씀:
+    // [패딩 4][프롤로그 헤더/푸터 8][가용 블록 ...][에필로그 헤더 4]
+    if (h->parent != NULL) {
+        char *cbp = mm_heap_malloc(h->parent, size + 2 * DSIZE);
+        if (cbp == NULL) {
+            return NULL;
+        }
+        size = (GET_SIZE(HDRP(cbp)) - 3 * DSIZE) & ~(size_t)(ALIGNMENT - 1);
+        PUT(cbp + (1 * WSIZE), PACK(DSIZE, 1));
+        PUT(cbp + (2 * WSIZE), PACK(DSIZE, 1));
+        bp = cbp + 2 * DSIZE;
+        PUT(HDRP(bp), PACK(size, 0));
+        PUT(FTRP(bp), PACK(size, 0));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+        insert_node(h, bp, size); // 양옆이 프롤로그/에필로그이므로 병합할 것 없음
+        return bp;
+    }
+
+    // 2. 영역 끝을 늘림. 영역이 가득 찼으면 마지막 세그먼트, 그것도 모자라면 새 세그먼트
+    //    (파일 힙과 공유 힙은 영역 하나가 곧 힙 전체여야 하므로 세그먼트를 쓰지 않음)
+    if ((bp = grow_region(h, h->region, size)) != NULL) {
+        return bp;
+    }
+    if (h->magic != 0 || h->shared) {
+        return NULL; // 메모리 부족 시 실패
+    }
+    if (h->seg_last != NULL && (bp = grow_region(h, h->seg_last, size)) != NULL) {
+        return bp;
+    }
+    return segment_create(h, size);
+}
+
+// --- 영역 끝 늘리기 ---
+// r: 힙의 영역 또는 세그먼트. 에필로그 자리에서 size 바이트를 늘려 가용 블록으로 만듦 (모자라면 NULL)
+static void *grow_region(mm_heap_t *h, mem_region_t *r, size_t size) {
+    char *bp;
+
+    if (mem_region_room(r) < size) {
+        return NULL;
+    }
+    bp = mem_region_sbrk(r, (intptr_t)size); // mem_sbrk 시스템 콜 흉내
+
+    // 3. 새로 생긴 영역을 가용 블록으로 초기화
+    PUT(HDRP(bp), PACK(size, 0));             // 새 가용 블록 헤더 (크기 size, 가용 상태 0)
+    PUT(FTRP(bp), PACK(size, 0));             // 새 가용 블록 푸터 (크기 size, 가용 상태 0)
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));   // 새 에필로그 헤더 (원래 에필로그 헤더 위치 덮어씀)
+
+    // 4. 만약 이전 블록이 가용 상태였다면, 새로 만든 블록과 병합
+    //    (extend_heap 직전의 블록이 free 상태일 수 있음)
+    return coalesce(h, bp); // 병합된 블록 (또는 원래 블록)의 포인터 반환
+}
+
+// --- 세그먼트 추가 ---
+// memlib에서 새 세그먼트를 받아 프롤로그/에필로그를 놓고 size 바이트 가용 블록으로 채움.
+// 주소 공간은 두 배로 잡아 두어 끝 블록이 realloc으로 자랄 때 세그먼트를 갈아타지 않게 함.
+// 세그먼트도 영역의 최대 크기 안에서 세므로(memlib이 spill을 허용한 영역만 예외) 남은 양이 모자라면 NULL
+static void *segment_create(mm_heap_t *h, size_t size) {
+    mem_region_t *seg;
+    char *p;
+
+    if (mem_segment_room(h->region) < SEG_HDR_SIZE + 4 * WSIZE + size) {
+        return NULL;
+    }
+    if ((seg = mem_segment_create(h->region, 2 * (SEG_HDR_SIZE + 4 * WSIZE + size))) == NULL) {
+        return NULL;
+    }
+    p = mem_region_sbrk(seg, SEG_HDR_SIZE + 4 * WSIZE);
+    *(mem_region_t **)p = seg; // 비었을 때 돌려줄 수 있게 영역을 적어 둠
+    p += SEG_HDR_SIZE;
+    PUT(p, 0);                            // 패딩
+    PUT(p + (1 * WSIZE), PACK(DSIZE, 1)); // 프롤로그 헤더
+    PUT(p + (2 * WSIZE), PACK(DSIZE, 1)); // 프롤로그 푸터
+    PUT(p + (3 * WSIZE), PACK(0, 1));     // 에필로그 헤더
+    h->seg_last = seg;
+    return grow_region(h, seg, size);
+}
+
+// --- 세그먼트 반납 ---
+// bp: 세그먼트 전체를 차지하는 가용 블록. 리스트에서 빼고 세그먼트를 memlib에 돌려줌
+static void segment_release(mm_heap_t *h, void *bp) {
+    mem_region_t *seg = SEG_OF(bp);
+
+    delete_node(h, bp);
+    if (seg == h->seg_last) {
+        h->seg_last = NULL;
+    }
+    mem_segment_destroy(seg);
+}
+
+// --- 리스트 인덱스 계산 헬퍼 ---
+// 주어진 크기(size)가 어떤 분리 리스트에 속하는지 계산
+// SC_TABLE_MAX 이하는 트레이스 프로파일로 만든 테이블을 한 번 읽어서 끝.
+// 그보다 크면 2의 거듭제곱 단위 클래스 (마지막 리스트는 나머지 큰 블록들 모두 포함)
+// 클래스 수를 줄여 쓰는 힙(h->classes < LISTLIMIT)은 그 위 클래스들을 마지막 리스트 하나로 합침
+static int get_list_index(mm_heap_t *h, size_t size) {
+    int list_idx;
+
+    if (size <= SC_TABLE_MAX) {
+        list_idx = sc_index[size >> SC_UNIT_SHIFT];
+    } else {
+        // size가 (2^k, 2^(k+1)] 범위면 k - SC_TABLE_LOG 번째 꼬리 클래스
+        list_idx = SC_TAIL_BASE
+                 + ((int)(8 * sizeof(size_t)) - 1 - __builtin_clzl(size - 1))
+                 - SC_TABLE_LOG;
+    }
+    return (list_idx < h->classes - 1) ? list_idx : h->classes - 1;
+}
+
+// --- hot bin 헤드 찾기 ---
+// hot bin으로 지정된 크기면 해당 bin의 헤드 주소, 아니면 NULL (분리 리스트 인덱스 소속).
+// insert_node/delete_node가 항상 이 함수를 거치므로 같은 블록은 같은 리스트에서 관리됨.
+static void **hot_bin_head(mm_heap_t *h, size_t size) {
+    for (int i = 0; i < HOT_BINS; i++) {
+        if (h->hot_bin_size[i] == size) {
+            return &h->hot_bin_lists[i];
+        }
+    }
+    return NULL;
+}
+
+// --- 힙 밖 메타데이터 배열 ---
+// 크기 인덱스 배열과 핸들 테이블. 보통은 mmap으로 받지만, 공유 힙은 다른 프로세스도 같은
+// 주소로 봐야 하고 파일 힙은 다음에 열 때 다시 써야 하므로 영역 꼭대기에서 떼어 오고
+// (2의 거듭제곱 크기), 반납된 배열은 크기별 목록에 두었다가 다시 씀. 어느 쪽이든 0으로 채워진 배열을 돌려줌
+static void *meta_alloc(mm_heap_t *h, size_t bytes) {
+    void *p;
+
+    if (!h->shared && h->magic == 0) {
+        p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return (p == MAP_FAILED) ? NULL : p;
+    }
+    int c = 0;
+    while (((size_t)1 << c) < bytes) c++;
+    if (c >= META_CLASSES) {
+        return NULL;
+    }
+    if ((p = h->meta_cache[c]) != NULL) {
+        h->meta_cache[c] = *(void **)p;
+        memset(p, 0, (size_t)1 << c);
+        return p;
+    }
+    return mem_region_reserve_top(h->region, (size_t)1 << c);
+}
+
+static void meta_release(mm_heap_t *h, void *p, size_t bytes) {
+    if (!h->shared && h->magic == 0) {
+        munmap(p, bytes);
+        return;
+    }
+    int c = 0;
+    while (((size_t)1 << c) < bytes) c++;
+    *(void **)p = h->meta_cache[c];
+    h->meta_cache[c] = p;
+}
+
+// --- 크기 인덱스 배열 확장 ---
+// 용량을 두 배로 늘린 새 배열을 받아 옮김. blk(8바이트)를 앞에, key를 뒤에 둠.
+static int index_grow(mm_heap_t *h, size_index_t *ix) {
+    size_t cap = ix->cap ? ix->cap * 2 : INDEX_INIT_CAP;
+    char *p = meta_alloc(h, cap * (sizeof(void *) + sizeof(uint32_t)));
+
+    if (p == NULL) {
+        return -1;
+    }
+    void **blk = (void **)p;
+    uint32_t *key = (uint32_t *)(p + cap * sizeof(void *));
+    if (ix->cap != 0) {
+        memcpy(blk, ix->blk, ix->n * sizeof(void *));
+        memcpy(key, ix->key, ix->n * sizeof(uint32_t));
+        meta_release(h, ix->blk, ix->cap * (sizeof(void *) + sizeof(uint32_t)));
+    }
+    ix->blk = blk;
+    ix->key = key;
+    ix->cap = cap;
+    return 0;
+}
+
+// --- 크기 인덱스에 블록 추가 ---
+// 맨 뒤에 붙이고 위치를 블록에 기록. 배열을 늘리지 못하면 블록은 재사용되지 않을 뿐 (NO_SLOT)
+static void index_insert(mm_heap_t *h, size_index_t *ix, void *bp, size_t size) {
+    if (ix->n == ix->cap && index_grow(h, ix) < 0) {
+        INDEX_SLOT(bp) = NO_SLOT;
+        return;
+    }
+    ix->key[ix->n] = SIZE_KEY(size);
+    ix->blk[ix->n] = bp;
+    INDEX_SLOT(bp) = ix->n++;
+}
+
+// --- 크기 인덱스에서 블록 제거 ---
+// 마지막 원소를 빈자리로 옮겨 배열을 연속으로 유지
+static void index_delete(size_index_t *ix, size_t slot) {
+    if (slot == NO_SLOT) return;
+    size_t last = --ix->n;
+    if (slot != last) {
+        ix->key[slot] = ix->key[last];
+        ix->blk[slot] = ix->blk[last];
+        INDEX_SLOT(ix->blk[slot]) = slot;
+    }
+}
+
+// --- 크기 인덱스 검색 ---
+// key[0..n) 중 target 이상인 가장 작은 값의 위치 (없으면 n). 분리 리스트가 크기순이던
+// 때의 first fit과 같은 블록(클래스 안의 best fit)을 고름.
+// key - target을 부호 없는 수로 보면 target보다 작은 key는 항상 더 큰 값으로 감기므로,
+// 그 최솟값 하나만 구하면 됨 (유효 조건: 최솟값 <= ~target).
+static size_t index_search_scalar(const uint32_t *key, size_t n, uint32_t target) {
+    uint32_t best = UINT32_MAX;
+    size_t pos = n;
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t d = key[i] - target;
+        if (d < best) {
+            best = d;
+            pos = i;
+            if (d == 0) break; // 정확히 맞는 크기
+        }
+    }
+    return (pos < n && best <= ~target) ? pos : n;
+}
+
+#ifdef HAVE_X86_SIMD
+// SSE4.1: 4개씩 차이의 최솟값을 구한 뒤, 그 값이 처음 나오는 위치를 다시 찾음
+__attribute__((target("sse4.1")))
+static size_t index_search_sse41(const uint32_t *key, size_t n, uint32_t target) {
+    __m128i t = _mm_set1_epi32((int)target);
+    __m128i m = _mm_set1_epi32(-1);
+    size_t i = 0;
+    uint32_t best, lane[4];
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i d = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(key + i)), t);
+        m = _mm_min_epu32(m, d);
+    }
+    _mm_storeu_si128((__m128i *)lane, m);
+    best = lane[0];
+    for (int k = 1; k < 4; k++) best = (lane[k] < best) ? lane[k] : best;
+    for (size_t j = i; j < n; j++) best = (key[j] - target < best) ? key[j] - target : best;
+    if (best > ~target) return n;
+
+    __m128i want = _mm_set1_epi32((int)(best + target));
+    for (i = 0; i + 4 <= n; i += 4) {
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(
+            _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(key + i)), want)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    for (; i < n; i++) {
+        if (key[i] == best + target) return i;
+    }
+    return n;
+}
+
+// AVX2: 같은 방식으로 8개씩
+__attribute__((target("avx2")))
+static size_t index_search_avx2(const uint32_t *key, size_t n, uint32_t target) {
+    __m256i t = _mm256_set1_epi32((int)target);
+    __m256i m = _mm256_set1_epi32(-1);
+    size_t i = 0;
+    uint32_t best, lane[8];
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i d = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(key + i)), t);
+        m = _mm256_min_epu32(m, d);
+    }
+    _mm256_storeu_si256((__m256i *)lane, m);
+    best = lane[0];
+    for (int k = 1; k < 8; k++) best = (lane[k] < best) ? lane[k] : best;
+    for (size_t j = i; j < n; j++) best = (key[j] - target < best) ? key[j] - target : best;
+    if (best > ~target) return n;
+
+    __m256i want = _mm256_set1_epi32((int)(best + target));
+    for (i = 0; i + 8 <= n; i += 8) {
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(
+            _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(key + i)), want)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    for (; i < n; i++) {
+        if (key[i] == best + target) return i;
+    }
+    return n;
+}
+#endif
+
+// CPU가 지원하는 가장 넓은 버전을 처음 호출 때 한 번만 골라 둠.
+// 여러 스레드가 동시에 처음 호출해도 pthread_once가 고르는 일을 한 번으로 묶어 줌
+static size_t (*index_search_impl)(const uint32_t *, size_t, uint32_t);
+static pthread_once_t index_search_once = PTHREAD_ONCE_INIT;
+
+static void index_search_select(void) {
+    index_search_impl = index_search_scalar;
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        index_search_impl = index_search_avx2;
+    } else if (__builtin_cpu_supports("sse4.1")) {
+        index_search_impl = index_search_sse41;
+    }
+#endif
+}
+
+static size_t index_search(const uint32_t *key, size_t n, uint32_t target) {
+    pthread_once(&index_search_once, index_search_select);
+    return index_search_impl(key, n, target);
+}
+
+// --- 블록 복사 (realloc 이동용) ---
+// 크기별로 나눔: 작으면 인라인 고정 크기 복사, 중간이면 SSE2/AVX2 루프, conf.copy_threshold 이상이면
+// 캐시를 거치지 않는 non-temporal 저장 (옮긴 큰 블록은 곧바로 다시 읽히지 않는 경우가 많음).
+// 두 블록은 겹치지 않아야 함 (새로 할당한 블록으로 옮길 때만 씀)
+
+// 작은 복사: 16/8/4바이트 단위 + 끝을 겹쳐 한 번 더 (분기 몇 개로 끝남)
+static inline void copy_small(char *d, const char *s, size_t n) {
+    if (n >= 16) {
+        for (size_t i = 0; i + 16 <= n; i += 16) memcpy(d + i, s + i, 16);
+        memcpy(d + n - 16, s + n - 16, 16);
+    } else if (n >= 8) {
+        memcpy(d, s, 8);
+        memcpy(d + n - 8, s + n - 8, 8);
+    } else if (n >= 4) {
+        memcpy(d, s, 4);
+        memcpy(d + n - 4, s + n - 4, 4);
+    } else {
+        for (size_t i = 0; i < n; i++) d[i] = s[i];
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+// SSE2: 64바이트씩, 끝은 마지막 16바이트를 겹쳐 씀 (n >= 16)
+__attribute__((target("sse2")))
+static void copy_sse2(char *d, const char *s, size_t n) {
+    size_t i = 0;
+
+    for (; i + 64 <= n; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + i + 32));
+        __m128i e = _mm_loadu_si128((const __m128i *)(s + i + 48));
+        _mm_storeu_si128((__m128i *)(d + i), a);
+        _mm_storeu_si128((__m128i *)(d + i + 16), b);
+        _mm_storeu_si128((__m128i *)(d + i + 32), c);
+        _mm_storeu_si128((__m128i *)(d + i + 48), e);
+    }
+    for (; i + 16 <= n; i += 16) {
+        _mm_storeu_si128((__m128i *)(d + i), _mm_loadu_si128((const __m128i *)(s + i)));
+    }
+    _mm_storeu_si128((__m128i *)(d + n - 16), _mm_loadu_si128((const __m128i *)(s + n - 16)));
+}
+
+// AVX2: 같은 방식으로 128바이트씩, 끝은 마지막 32바이트 (n >= 32)
+__attribute__((target("avx2")))
+static void copy_avx2(char *d, const char *s, size_t n) {
+    size_t i = 0;
+
+    for (; i + 128 <= n; i += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(s + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(s + i + 64));
+        __m256i e = _mm256_loadu_si256((const __m256i *)(s + i + 96));
+        _mm256_storeu_si256((__m256i *)(d + i), a);
+        _mm256_storeu_si256((__m256i *)(d + i + 32), b);
+        _mm256_storeu_si256((__m256i *)(d + i + 64), c);
+        _mm256_storeu_si256((__m256i *)(d + i + 96), e);
+    }
+    for (; i + 32 <= n; i += 32) {
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_loadu_si256((const __m256i *)(s + i)));
+    }
+    _mm256_storeu_si256((__m256i *)(d + n - 32), _mm256_loadu_si256((const __m256i *)(s + n - 32)));
+}
+
+// non-temporal: 목적지를 16바이트 경계에 맞춘 뒤 스트리밍 저장, 끝에서 sfence (n >= 64)
+__attribute__((target("sse2")))
+static void copy_stream(char *d, const char *s, size_t n) {
+    size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+    size_t i;
+
+    _mm_storeu_si128((__m128i *)d, _mm_loadu_si128((const __m128i *)s));
+    for (i = head; i + 64 <= n; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + i + 32));
+        __m128i e = _mm_loadu_si128((const __m128i *)(s + i + 48));
+        _mm_stream_si128((__m128i *)(d + i), a);
+        _mm_stream_si128((__m128i *)(d + i + 16), b);
+        _mm_stream_si128((__m128i *)(d + i + 32), c);
+        _mm_stream_si128((__m128i *)(d + i + 48), e);
+    }
+    _mm_sfence();
+    if (n - i >= 16) {
+        copy_sse2(d + i, s + i, n - i); // 남은 꼬리
+    } else if (i < n) {
+        _mm_storeu_si128((__m128i *)(d + n - 16), _mm_loadu_si128((const __m128i *)(s + n - 16)));
+    }
+}
+#endif
+
+#ifdef HAVE_X86_SIMD
+// 중간 크기 복사 루틴: CPU가 지원하는 가장 넓은 버전을 처음 쓸 때 pthread_once로 한 번만 고름
+static void (*copy_medium)(char *, const char *, size_t);
+static pthread_once_t copy_medium_once = PTHREAD_ONCE_INIT;
+
+static void copy_medium_select(void) {
+    __builtin_cpu_init();
+    copy_medium = __builtin_cpu_supports("avx2") ? copy_avx2 : copy_sse2;
+}
+#endif
+
+static void block_copy(void *dst, const void *src, size_t n) {
+    char *d = dst;
+    const char *s = src;
+
+    if (n <= COPY_INLINE_MAX) {
+        copy_small(d, s, n);
+        return;
+    }
+#ifdef HAVE_X86_SIMD
+    if (conf.copy_threshold != 0 && n >= conf.copy_threshold) {
+        copy_stream(d, s, n);
+        return;
+    }
+    pthread_once(&copy_medium_once, copy_medium_select);
+    copy_medium(d, s, n);
+#else
+    memcpy(d, s, n);
+#endif
+}
+
+// --- 요청 크기 sketch 갱신 ---
+// Space-Saving: 이미 추적 중인 크기면 카운트 증가, 아니면 카운트가 가장 작은 슬롯을 빼앗음.
+// SKETCH_PERIOD번마다 hot bin을 다시 고름.
+static void sketch_record(mm_heap_t *h, size_t asize) {
+    int min_slot = 0;
+
+    for (int i = 0; i < SKETCH_SLOTS; i++) {
+        if (h->sketch_size[i] == asize) {
+            h->sketch_count[i]++;
+            min_slot = -1;
+            break;
+        }
+        if (h->sketch_count[i] < h->sketch_count[min_slot]) {
+            min_slot = i;
+        }
+    }
+    if (min_slot >= 0) { // 새 크기: 가장 덜 쓰인 슬롯 교체 (기존 카운트 + 1 로 시작)
+        h->sketch_size[min_slot] = asize;
+        h->sketch_count[min_slot]++;
+    }
+
+    // worker가 돌고 있으면 재선정은 worker가 맡음 (malloc 경로에서 빠짐)
+    if (++h->sketch_ticks >= SKETCH_PERIOD && !__atomic_load_n(&h->defer_on, __ATOMIC_RELAXED)) {
+        update_hot_bins(h);
+        h->sketch_ticks = 0;
+    }
+}
+
+// --- hot bin 재선정 ---
+// sketch에서 빈도 상위 HOT_BINS개 크기(최소 점유율 이상)를 골라 bin을 배정.
+// 빠진 크기의 bin은 블록들을 분리 리스트로 돌려보내고(retire),
+// 새로 뽑힌 크기는 분리 리스트에 있던 같은 크기 블록들을 bin으로 옮겨옴.
+static void update_hot_bins(mm_heap_t *h) {
+    size_t top[HOT_BINS] = {0};
+    unsigned int top_count[HOT_BINS] = {0};
+    unsigned int min_count = SKETCH_PERIOD / HOT_MIN_SHARE;
+
+    // 1. 상위 K개 크기 선정 (삽입 정렬, K가 작으므로 충분)
+    for (int i = 0; i < SKETCH_SLOTS; i++) {
+        if (h->sketch_count[i] < min_count || h->sketch_size[i] == 0) continue;
+        for (int k = 0; k < HOT_BINS; k++) {
+            if (h->sketch_count[i] > top_count[k]) {
+                for (int m = HOT_BINS - 1; m > k; m--) {
+                    top[m] = top[m - 1];
+                    top_count[m] = top_count[m - 1];
+                }
+                top[k] = h->sketch_size[i];
+                top_count[k] = h->sketch_count[i];
+                break;
+            }
+        }
+    }
+
+    // 2. 더 이상 hot이 아닌 bin 해제: 슬롯을 비운 뒤 블록들을 다시 list_insert
+    for (int i = 0; i < HOT_BINS; i++) {
+        int keep = 0;
+        if (h->hot_bin_size[i] == 0) continue;
+        for (int k = 0; k < HOT_BINS; k++) {
+            if (top[k] == h->hot_bin_size[i]) {
+                keep = 1;
+                top[k] = 0; // 이미 bin이 있으므로 새로 만들 필요 없음
+            }
+        }
+        if (keep) continue;
+
+        void *bp = h->hot_bin_lists[i];
+        size_t size = h->hot_bin_size[i];
+        h->hot_bin_size[i] = 0;
+        h->hot_bin_lists[i] = NULL;
+        while (bp != NULL) {
+            void *next = SUCC_PTR(bp);
+            list_insert(h, bp, size);
+            bp = next;
+        }
+    }
+
+    // 3. 새 hot 크기에 빈 슬롯 배정 후, 분리 리스트의 같은 크기 블록을 옮겨옴
+    for (int k = 0; k < HOT_BINS; k++) {
+        if (top[k] == 0) continue;
+        for (int i = 0; i < HOT_BINS; i++) {
+            if (h->hot_bin_size[i] != 0) continue;
+
+            size_index_t *ix = &h->seg_index[get_list_index(h, top[k])];
+            uint32_t key = SIZE_KEY(top[k]);
+            void *moved = NULL; // 분리 리스트에서 떼어낸 블록들 (SUCC_PTR로 임시 연결)
+
+            // 뒤에서부터 훑으면 삭제 때 옮겨 오는 마지막 원소는 이미 검사한 것
+            for (size_t j = ix->n; j-- > 0; ) {
+                if (ix->key[j] != key) continue;
+                void *bp = ix->blk[j];
+                index_delete(ix, j);
+                SUCC_PTR(bp) = moved;
+                moved = bp;
+            }
+
+            h->hot_bin_size[i] = top[k];
+            while (moved != NULL) {
+                void *next = SUCC_PTR(moved);
+                list_insert(h, moved, top[k]); // 이제 hot bin으로 들어감
+                moved = next;
+            }
+            break;
+        }
+    }
+
+    // 4. 오래된 빈도가 계속 남지 않도록 카운트를 절반으로 감쇠
+    for (int i = 0; i < SKETCH_SLOTS; i++) {
+        h->sketch_count[i] >>= 1;
+    }
+}
+
+// --- 가용 블록 리스트에 노드 삽입 (크기 오름차순) ---
+// bp: 삽입할 가용 블록, size: 블록 크기
+static void insert_node(mm_heap_t *h, void *bp, size_t size) {
+    if (size >= h->decay_min) { // 페이지를 품은 블록은 decay 목록에도 걸어 둠
+        decay_insert(h, bp);
+    }
+    list_insert(h, bp, size);
+}
+
+// --- 가용 리스트/인덱스에만 삽입 ---
+// decay 목록은 건드리지 않음 (update_hot_bins처럼 이미 가용인 블록을 옮길 때)
+static void list_insert(mm_heap_t *h, void *bp, size_t size) {
+    void **head = hot_bin_head(h, size); // hot bin이면 연결 리스트에 삽입
+    if (head == NULL) { // 아니면 크기 클래스의 인덱스에 추가
+        index_insert(h, &h->seg_index[get_list_index(h, size)], bp, size);
+        return;
+    }
+    void *search_ptr = *head; // 해당 리스트 시작점부터 탐색
+    void *insert_prev = NULL; // 삽입 위치의 이전 노드를 기억할 포인터
+
+    // 1. 리스트 내에서 크기 순서에 맞는 삽입 위치 찾기
+    //    (현재 블록(bp)의 size보다 크거나 같은 블록을 만날 때까지 이동)
+    while ((search_ptr != NULL) && (size > GET_SIZE(HDRP(search_ptr)))) {
+        insert_prev = search_ptr;
+        search_ptr = SUCC_PTR(search_ptr); // 다음 노드로
+    }
+
+    // 2. 찾은 위치에 bp 삽입 (4가지 경우 처리 - 리스트 맨 앞, 중간, 맨 뒤, 빈 리스트)
+    if (search_ptr != NULL) { // 중간 또는 맨 앞에 삽입
+        if (insert_prev != NULL) { // 중간 삽입 (insert_prev와 search_ptr 사이)
+            SUCC_PTR(bp) = search_ptr;
+            PRED_PTR(bp) = insert_prev;
+            PRED_PTR(search_ptr) = bp;
+            SUCC_PTR(insert_prev) = bp;
+        } else { // 맨 앞에 삽입 (list_head가 search_ptr)
+            SUCC_PTR(bp) = search_ptr;
+            PRED_PTR(bp) = NULL;
+            PRED_PTR(search_ptr) = bp;
+            *head = bp; // 리스트 헤드 변경
+        }
+    } else { // 맨 뒤 또는 빈 리스트에 삽입
+        if (insert_prev != NULL) { // 맨 뒤 삽입 (insert_prev 다음)
+            SUCC_PTR(bp) = NULL;
+            PRED_PTR(bp) = insert_prev;
+            SUCC_PTR(insert_prev) = bp;
+        } else { // 빈 리스트에 삽입 (list_head가 NULL)
+            SUCC_PTR(bp) = NULL;
+            PRED_PTR(bp) = NULL;
+            *head = bp; // 리스트 헤드 변경
+        }
+    }
+}
+
+// --- 가용 블록 리스트에서 노드 삭제 ---
+// bp: 삭제할 가용 블록
+static void delete_node(mm_heap_t *h, void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    if (size >= h->decay_min && DECAY_STAMP(bp) != 0) {
+        decay_delete(h, bp);
+    }
+    void **head = hot_bin_head(h, size); // 해당 리스트 찾기
+    if (head == NULL) { // 분리 리스트 블록은 인덱스에서 자기 자리를 지움
+        index_delete(&h->seg_index[get_list_index(h, size)], INDEX_SLOT(bp));
+        return;
+    }
+    void *prev_fp = PRED_PTR(bp); // 삭제할 노드의 이전 노드
+    void *next_fp = SUCC_PTR(bp); // 삭제할 노드의 다음 노드
+
+    // 이전 노드 처리
+    if (prev_fp == NULL) { // 삭제할 노드가 리스트의 헤드인 경우
+        *head = next_fp; // 리스트 헤드를 다음 노드로 변경
+    } else { // 삭제할 노드가 중간 또는 꼬리인 경우
+        SUCC_PTR(prev_fp) = next_fp; // 이전 노드가 다음 노드를 가리키도록 변경
+    }
+
+    // 다음 노드 처리 (삭제할 노드가 꼬리가 아닌 경우)
+    if (next_fp != NULL) {
+        PRED_PTR(next_fp) = prev_fp; // 다음 노드가 이전 노드를 가리키도록 변경
+    }
+    // bp 내부의 PRED/SUCC 포인터는 이제 업데이트할 필요 없음 (어차피 사용 안 함)
+}
+
+// --- 인접 가용 블록 병합 (Dispatcher 역할) ---
+// bp: 현재 (막 해제되었거나 새로 생성된) 가용 블록
+static void *coalesce(mm_heap_t *h, void *bp) {
+    // 이전/다음 블록 정보 확인
+    void *prev_footer = FTRP(PREV_BLKP(bp)); // 이전 블록 푸터 (정확히는 bp 시작 - DSIZE)
+    void *next_header = HDRP(NEXT_BLKP(bp)); // 다음 블록 헤더
+    size_t prev_alloc = GET_ALLOC(prev_footer); // 이전 블록 할당 상태
+    size_t next_alloc = GET_ALLOC(next_header); // 다음 블록 할당 상태
+    size_t size = GET_SIZE(HDRP(bp));           // 현재 블록 크기
+
+    // 이전/다음 블록의 할당 상태에 따라 4가지 경우로 나누어 처리
+    if (prev_alloc && next_alloc) {         // Case 1: 둘 다 할당됨 (병합 없음)
+        return coalesce_case1(h, bp, size);
+    }
+    else if (prev_alloc && !next_alloc) { // Case 2: 다음 블록만 가용
+        void *next_bp = NEXT_BLKP(bp);
+        size_t next_size = GET_SIZE(HDRP(next_bp));
+        return coalesce_case2(h, bp, size, next_bp, next_size);
+    }
+    else if (!prev_alloc && next_alloc) { // Case 3: 이전 블록만 가용
+        void *prev_bp = PREV_BLKP(bp);
+        size_t prev_size = GET_SIZE(HDRP(prev_bp)); // 이전 블록 헤더에서 크기 읽기
+        return coalesce_case3(h, size, prev_bp, prev_size);
+    }
+    else {                                // Case 4: 둘 다 가용
+        void *prev_bp = PREV_BLKP(bp);
+        void *next_bp = NEXT_BLKP(bp);
+        size_t prev_size = GET_SIZE(HDRP(prev_bp));
+        size_t next_size = GET_SIZE(HDRP(next_bp));
+        return coalesce_case4(h, size, prev_bp, prev_size, next_bp, next_size);
+    }
+}
+
+// --- 가용 블록 기록 ---
+// bp부터 size 바이트를 가용 블록으로 표시하고 리스트에 넣음.
+// 4GB를 넘으면서 4KB 배수가 아니면 헤더에 담을 수 없으므로,
+// 뒤쪽 자투리를 작은 가용 블록으로 떼어 두 블록으로 기록 (큰 블록끼리의 병합은 그대로 유지됨)
+// 자투리를 흡수하면 시작점이 앞당겨질 수 있으므로 최종 블록 포인터를 반환
+static void *make_free_block(mm_heap_t *h, void *bp, size_t size) {
+    if (size > SMALL_MAX) {
+        // 예전에 이렇게 떼어 둔 자투리가 양옆에 붙어 있을 수 있으므로 함께 흡수
+        while (!GET_ALLOC((char *)bp - DSIZE)) {
+            void *prev_bp = PREV_BLKP(bp);
+            delete_node(h, prev_bp);
+            size += GET_SIZE(HDRP(prev_bp));
+            bp = prev_bp;
+        }
+        while (!GET_ALLOC(HDRP((char *)bp + size))) {
+            void *next_bp = (char *)bp + size;
+            delete_node(h, next_bp);
+            size += GET_SIZE(HDRP(next_bp));
+        }
+    }
+    if (!SIZE_FITS(size)) {
+        size_t tail = size & (LARGE_UNIT - 1);
+        if (tail < MIN_BLOCK_SIZE) {
+            tail += LARGE_UNIT; // 자투리도 최소 블록 크기는 되어야 함
+        }
+        size -= tail;
+        void *tail_bp = (char *)bp + size;
+        if (h->purge_stats.released != 0) { // 자투리 머리가 반납했던 페이지에 놓일 수 있음
+            purge_touch(h, HDRP(tail_bp), (char *)tail_bp + DECAY_HEAD, 1);
+        }
+        PUT(HDRP(tail_bp), PACK(tail, 0));
+        PUT(FTRP(tail_bp), PACK(tail, 0));
+        insert_node(h, tail_bp, tail);
+    }
+    if (h->purge_stats.released != 0) { // 큰 블록을 쪼갠 경우 머리가 반납했던 페이지에 놓일 수 있음
+        purge_touch(h, HDRP(bp), (char *)bp + DECAY_HEAD, 1);
+    }
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+    insert_node(h, bp, size);
+    return bp;
+}
+
+// --- Coalesce Helper: Case 1 (병합 없음) ---
+static void *coalesce_case1(mm_heap_t *h, void *bp, size_t size) {
+    // 현재 블록(bp)을 가용 리스트에 삽입하기만 함
+    insert_node(h, bp, size);
+    return bp; // 현재 블록 포인터 반환
+}
+
+// --- Coalesce Helper: Case 2 (다음 블록과 병합) ---
+static void *coalesce_case2(mm_heap_t *h, void *bp, size_t size, void* next_bp, size_t next_size) {
+    delete_node(h, next_bp);          // 다음 블록을 리스트에서 제거
+    size += next_size;             // 크기 합산
+    return make_free_block(h, bp, size); // 헤더/푸터 갱신 후 삽입, 병합된 블록 시작 반환
+}
+
+// --- Coalesce Helper: Case 3 (이전 블록과 병합) ---
+static void *coalesce_case3(mm_heap_t *h, size_t size, void* prev_bp, size_t prev_size) {
+    delete_node(h, prev_bp);          // 이전 블록을 리스트에서 제거
+    size += prev_size;             // 크기 합산
+    // 이전 블록 헤더 ~ *현재 블록의 푸터*를 새 크기로 갱신 후 삽입, 병합된 블록 시작 반환
+    return make_free_block(h, prev_bp, size);
+}
+
+// --- Coalesce Helper: Case 4 (양쪽 블록과 병합) ---
+static void *coalesce_case4(mm_heap_t *h, size_t size, void* prev_bp, size_t prev_size, void* next_bp, size_t next_size) {
+    delete_node(h, prev_bp);          // 이전 블록 제거
+    delete_node(h, next_bp);          // 다음 블록 제거
+    size += prev_size + next_size; // 세 블록 크기 합산
+    // 이전 블록 헤더 ~ *다음 블록의 푸터*를 새 크기로 갱신 후 삽입, 병합된 블록 시작 반환
+    return make_free_block(h, prev_bp, size);
+}
+
+// --- decay 시각 ---
+// ms 단위 단조 시각 + 1 (0은 '목록에 없음' 표시로 씀). 정밀도는 필요 없으므로 값싼 COARSE 시계
+static uint64_t decay_now(void) {
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 + 1;
+}
+
+// --- decay 목록에 추가 ---
+// 새로 생긴(또는 병합으로 커진) 가용 블록을 지금 시각으로 목록 끝에 붙임
+static void decay_insert(mm_heap_t *h, char *bp) {
+    DECAY_STAMP(bp) = decay_now();
+    DECAY_NEXT(bp) = NULL;
+    DECAY_PREV(bp) = h->decay_tail;
+    if (h->decay_tail != NULL) {
+        DECAY_NEXT(h->decay_tail) = bp;
+    } else {
+        h->decay_head = bp;
+    }
+    h->decay_tail = bp;
+}
+
+// --- decay 목록에서 제거 ---
+static void decay_delete(mm_heap_t *h, char *bp) {
+    char *prev = DECAY_PREV(bp);
+    char *next = DECAY_NEXT(bp);
+
+    if (prev != NULL) {
+        DECAY_NEXT(prev) = next;
+    } else {
+        h->decay_head = next;
+    }
+    if (next != NULL) {
+        DECAY_PREV(next) = prev;
+    } else {
+        h->decay_tail = prev;
+    }
+    DECAY_STAMP(bp) = 0;
+}
+
+// --- 오래된 가용 페이지 반납 ---
+// 목록은 들어온 순서이므로 앞에서부터 decay_ms가 지난 블록만 꺼내 안쪽 페이지를 돌려줌
+// (all이면 시각과 상관없이 전부). 꺼낸 블록은 가용 상태 그대로 리스트에 남음. 반납한 페이지 수 반환
+static size_t decay_purge(mm_heap_t *h, int all) {
+    uint64_t now = decay_now();
+    size_t pages = 0;
+    char *bp;
+
+    if (!all && h->decay_ms < 0) {
+        return 0;
+    }
+    while ((bp = h->decay_head) != NULL && (all || now - DECAY_STAMP(bp) >= (uint64_t)h->decay_ms)) {
+        decay_delete(h, bp);
+        pages += purge_span(h, bp + DECAY_HEAD, FTRP(bp));
+    }
+    return pages;
+}
+
+// --- 페이지 반납 ---
+// [lo, hi) 안에 온전히 들어가는 페이지 중 아직 반납하지 않은 것들을 돌려주고 비트맵에 표시.
+// 비트맵은 힙 밖 배열로, 필요한 만큼 두 배씩 늘림. 반납한 페이지 수 반환
+static size_t purge_span(mm_heap_t *h, char *lo, char *hi) {
+    size_t page = mem_pagesize();
+    size_t first = ((size_t)(lo - h->purge_base) + page - 1) / page;
+    size_t last = (size_t)(hi - h->purge_base) / page; // 이 페이지는 포함하지 않음
+    size_t pages = 0, run = 0;
+
+    if (lo < h->purge_base || hi > (char *)mem_region_hi(h->region) + 1) {
+        return 0; // 세그먼트의 블록: 비트맵 밖 (세그먼트는 비면 통째로 반납됨)
+    }
+    if (last <= first) {
+        return 0;
+    }
+    if (last > h->purge_map_words * 64) {
+        size_t words = h->purge_map_words ? h->purge_map_words : 64;
+        while (words * 64 < last) words *= 2;
+        uint64_t *map = meta_alloc(h, words * sizeof(uint64_t));
+        if (map == NULL) {
+            return 0; // 표시할 곳이 없으면 반납하지 않음
+        }
+        if (h->purge_map != NULL) {
+            memcpy(map, h->purge_map, h->purge_map_words * sizeof(uint64_t));
+            meta_release(h, h->purge_map, h->purge_map_words * sizeof(uint64_t));
+        }
+        h->purge_map = map;
+        h->purge_map_words = words;
+    }
+
+    // 이미 반납한 페이지는 건너뛰고, 연속된 나머지 페이지를 한 번의 madvise로 돌려줌
+    for (size_t i = first; i <= last; i++) {
+        if (i < last && !(h->purge_map[i / 64] & ((uint64_t)1 << (i % 64)))) {
+            h->purge_map[i / 64] |= (uint64_t)1 << (i % 64);
+            run++;
+            continue;
+        }
+        if (run != 0) {
+            mem_region_purge(h->region, h->purge_base + (i - run) * page, run * page);
+            pages += run;
+            run = 0;
+        }
+    }
+    h->purge_stats.purged += pages;
+    h->purge_stats.released += pages;
+    return pages;
+}
+
+// --- 반납한 페이지 다시 쓰기 ---
+// [lo, hi)와 겹치는 반납 페이지의 표시를 지움. reuse면 곧 다시 쓰일 페이지이므로
+// 새 페이지 폴트로 셈 (힙을 잘라내서 없어지는 페이지는 아님)
+static void purge_touch(mm_heap_t *h, char *lo, char *hi, int reuse) {
+    size_t page = mem_pagesize();
+    size_t first = (size_t)(lo - h->purge_base) / page;
+    size_t last = ((size_t)(hi - h->purge_base) + page - 1) / page;
+
+    if (lo < h->purge_base || hi > (char *)mem_region_hi(h->region) + 1) {
+        return; // 세그먼트의 블록은 반납한 적이 없음
+    }
+    if (last > h->purge_map_words * 64) {
+        last = h->purge_map_words * 64;
+    }
+    for (size_t i = first; i < last; i++) {
+        uint64_t bit = (uint64_t)1 << (i % 64);
+        if (h->purge_map[i / 64] & bit) {
+            h->purge_map[i / 64] &= ~bit;
+            h->purge_stats.released--;
+            h->purge_stats.refaults += reuse;
+        }
+    }
+}
+
+
+// --- 기본 힙 API ---
+void *mm_malloc(size_t size) {
+    return mm_heap_malloc(&default_heap, size);
+}
+
+void mm_free(void *ptr) {
+    mm_heap_free(&default_heap, ptr);
+}
+
+void *mm_realloc(void *ptr, size_t size) {
+    return mm_heap_realloc(&default_heap, ptr, size);
+}
+
+void *mm_malloc_hint(size_t size, int hint) {
+    return mm_heap_malloc_hint(&default_heap, size, hint);
+}
+
+void *mm_memalign(size_t align, size_t size) {
+    return mm_heap_memalign(&default_heap, align, size);
+}
+
+// 페이로드로 쓸 수 있는 크기. 두 엔진 모두 페이로드 바로 앞 워드가 분리 리스트 형식 헤더
+size_t mm_usable_size(void *ptr) {
+    return (ptr == NULL) ? 0 : GET_SIZE(HDRP(ptr)) - DSIZE;
+}
+
+// --- realloc 복사 기준 ---
+// bytes 이상을 옮길 때 non-temporal 저장을 씀 (0이면 쓰지 않음). 이전 값 반환
+size_t mm_set_copy_threshold(size_t bytes) {
+    size_t old;
+
+    conf_load();
+    old = conf.copy_threshold;
+    conf.copy_threshold = bytes;
+    return old;
+}
+
+// --- 엔진 선택 ---
+// 다음 mm_init부터 쓸 엔진을 정함. 이전에 고른 엔진 반환 (모르는 엔진이면 -1)
+int mm_set_engine(int e) {
+    int old;
+
+    if (e != MM_ENGINE_SEGLIST && e != MM_ENGINE_BUDDY) {
+        return -1;
+    }
+    conf_load();
+    old = conf.engine;
+    conf.engine = e;
+    return old;
+}
+
+// --- 실행 중 설정 ---
+// 설정 값 정리: 0인 청크/클래스 수/분할 기준은 기본값, 나머지는 쓸 수 있는 범위로 맞춤 (모르는 엔진이면 -1)
+static int conf_fix(mm_config_t *c) {
+    if (c->engine != MM_ENGINE_SEGLIST && c->engine != MM_ENGINE_BUDDY) {
+        return -1;
+    }
+    c->chunk_size = (c->chunk_size == 0) ? CHUNKSIZE : MAX(ALIGN(c->chunk_size), MIN_BLOCK_SIZE);
+    if (c->classes == 0 || c->classes > LISTLIMIT) {
+        c->classes = LISTLIMIT; // 클래스 테이블(sizeclass.h)보다 많이 쓸 수는 없음
+    }
+    c->split_min = MAX(ALIGN(c->split_min), MIN_BLOCK_SIZE);
+    if (c->tail_min != 0) { // 캐시 라인 배치를 받는 작은 블록(페이로드 CACHE_LINE 이하)과 겹치지 않게
+        c->tail_min = MAX(ALIGN(c->tail_min), CACHE_LINE + DSIZE);
+    }
+    c->line_place = (c->line_place != 0);
+    c->hot_bins = (c->hot_bins != 0);
+    return 0;
+}
+
+// MM_CONF를 처음 한 번 읽어 기본값 위에 덮어씀. 잘못된 항목은 알리고 건너뜀
+static void conf_load(void) {
+    const char *env;
+
+    if (conf_loaded) {
+        return;
+    }
+    conf_loaded = 1;
+    if ((env = getenv("MM_CONF")) != NULL && mm_config_parse(&conf, env) < 0) {
+        fprintf(stderr, "mm: ignoring bad entries in MM_CONF \"%s\"\n", env);
+    }
+    conf_fix(&conf);
+}
+
+// "64K", "1M" 같은 크기 값 (접미사 K/M/G). 숫자가 아니면 -1
+static int conf_size(const char *s, size_t len, size_t *out) {
+    char buf[32], *end;
+    unsigned long long v;
+    int shift = 0;
+
+    if (len == 0 || len >= sizeof(buf)) {
+        return -1;
+    }
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    errno = 0;
+    v = strtoull(buf, &end, 0);
+    switch (*end) {
+    case 'k': case 'K': shift = 10; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'g': case 'G': shift = 30; end++; break;
+    }
+    // 접미사를 곱하면 size_t를 넘는 값도 잘못된 값 (그냥 밀면 잘려서 엉뚱한 크기가 됨)
+    if (errno != 0 || end == buf || *end != '\0' || buf[0] == '-' || v > (SIZE_MAX >> shift)) {
+        return -1;
+    }
+    *out = (size_t)v << shift;
+    return 0;
+}
+
+// str: "키=값" 항목들 (쉼표나 공백으로 구분). 알아본 항목은 c에 반영하고, 하나라도 잘못됐으면 -1
+int mm_config_parse(mm_config_t *c, const char *str) {
+    int ret = 0;
+
+    while (*str != '\0') {
+        size_t len = strcspn(str, ", \t"), klen, vlen;
+        const char *eq = memchr(str, '=', len), *val;
+        size_t v;
+        int ok = 0;
+
+        if (len == 0) { // 구분자가 이어짐
+            str++;
+            continue;
+        }
+        if (eq != NULL) {
+            klen = (size_t)(eq - str);
+            val = eq + 1;
+            vlen = len - klen - 1;
+#define KEY(name) (klen == sizeof(name) - 1 && memcmp(str, name, klen) == 0)
+#define VAL(name) (vlen == sizeof(name) - 1 && memcmp(val, name, vlen) == 0)
+            if (KEY("engine")) {
+                ok = 1;
+                if (VAL("seglist") || VAL("0")) c->engine = MM_ENGINE_SEGLIST;
+                else if (VAL("buddy") || VAL("1")) c->engine = MM_ENGINE_BUDDY;
+                else ok = 0;
+            } else if (KEY("decay")) { // 음수면 자동 반납 안 함
+                char buf[32], *end;
+                if (vlen > 0 && vlen < sizeof(buf)) {
+                    memcpy(buf, val, vlen);
+                    buf[vlen] = '\0';
+                    long ms = strtol(buf, &end, 10);
+                    if (*end == '\0') {
+                        c->decay_ms = ms;
+                        ok = 1;
+                    }
+                }
+            } else if (conf_size(val, vlen, &v) == 0) {
+                ok = 1;
+                if (KEY("chunk")) c->chunk_size = v;
+                else if (KEY("classes")) c->classes = (v > LISTLIMIT) ? LISTLIMIT : (unsigned int)v;
+                else if (KEY("split")) c->split_min = v;
+                else if (KEY("tail")) c->tail_min = v;
+                else if (KEY("reserve")) c->reserve = v;
+                else if (KEY("max_heap")) c->max_heap = v;
+                else if (KEY("line")) c->line_place = (v != 0);
+                else if (KEY("hot")) c->hot_bins = (v != 0);
+                else if (KEY("copy")) c->copy_threshold = v;
+                else ok = 0;
+            }
+#undef KEY
+#undef VAL
+        }
+        if (!ok) {
+            ret = -1;
+        }
+        str += len;
+    }
+    return ret;
+}
+
+// 지금 쓰이는 설정 (기본값 ← MM_CONF ← mm_init_ex/mm_set_* 순으로 덮어쓴 결과)
+void mm_get_config(mm_config_t *c) {
+    conf_load();
+    *c = conf;
+}
+
+// c를 현재 설정으로 삼고 기본 힙을 다시 만듦 (NULL이면 현재 설정 그대로)
+int mm_init_ex(const mm_config_t *c) {
+    conf_load();
+    if (c != NULL) {
+        mm_config_t next = *c;
+        if (conf_fix(&next) < 0) {
+            return -1;
+        }
+        conf = next;
+    }
+    return mm_init();
+}
+
+// --- quick list 비우기 ---
+// 이 스레드의 quick list에 모아 둔 블록을 모두 기본 힙에 돌려줌
+void mm_quick_flush(void) {
+    for (int c = 0; c <= MM_QUICK_CLASSES; c++) {
+        void *bp = mm_quick.head[c];
+
+        while (bp != NULL) {
+            void *next = *(void **)bp;
+            mm_free(bp);
+            bp = next;
+        }
+        mm_quick.head[c] = NULL;
+        mm_quick.count[c] = 0;
+    }
+}
+
+// --- 수명 힌트 할당 ---
+// MM_SHORT_LIVED는 nursery 청크에서, 나머지(MM_LONG_LIVED, 힌트 없음)는 힙 본체에서 할당.
+// 해제/재할당은 헤더의 SHORT_TAG로 구분하므로 그냥 mm_heap_free/mm_heap_realloc을 쓰면 됨.
+// 버디 힙은 힌트를 무시함
+void *mm_heap_malloc_hint(mm_heap_t *h, size_t size, int hint) {
+    void *bp;
+
+    if ((hint & MM_SHORT_LIVED) && !(hint & MM_LONG_LIVED) && h->nursery != NULL &&
+        h->engine != MM_ENGINE_BUDDY) {
+        HEAP_LOCK(h, NULL); // nursery는 부모 힙의 lock을 같이 씀
+        bp = heap_malloc(h->nursery, size);
+        HEAP_UNLOCK(h);
+        return bp;
+    }
+    return mm_heap_malloc(h, size);
+}
+
+// --- 공유 힙 잠금 ---
+// 공유 힙이면 공개 함수마다 프로세스 간 공유 lock을 잡고 내부 구현(heap_xxx)을 부름.
+// lock은 재귀형이라 핸들 함수처럼 안에서 다시 mm_heap_malloc을 불러도 됨.
+// lock을 쥔 채 죽은 프로세스가 있으면(EOWNERDEAD) 경계 태그나 인덱스를 고치던 중이었을 수 있으므로
+// 블록을 훑어 인덱스와 핸들 테이블을 다시 만든 뒤에야 계속 씀. 훑기가 실패하면 consistent 없이
+// 풀어서 mutex를 복구할 수 없게 두므로, 그 뒤로는 이 힙의 모든 호출이 실패함 (EINVAL)
+static int heap_lock(mm_heap_t *h) {
+    int ret = pthread_mutex_lock(&h->lock);
+
+    if (ret == EOWNERDEAD) {
+        if (heap_rebuild(h) < 0) {
+            pthread_mutex_unlock(&h->lock);
+            errno = EINVAL;
+            return -1;
+        }
+        pthread_mutex_consistent(&h->lock);
+        return 0;
+    }
+    if (ret != 0) {
+        errno = EINVAL; // ENOTRECOVERABLE: 이전에 복구하지 못한 힙
+        return -1;
+    }
+    return 0;
+}
+
+// --- lock 켜고 끄기 ---
+// lock이 필요한지(공유 힙, lock_user, worker) 다시 따져서, 꺼져 있다 켜지면 재귀 mutex를 만들고
+// 더는 필요 없으면 없앰. 다른 스레드가 이 힙을 쓰지 않을 때만 부름 (locking 값을 lock 없이 읽으므로)
+static void lock_update(mm_heap_t *h) {
+    int want = h->shared || h->lock_user || h->defer_slots != NULL;
+    pthread_mutexattr_t attr;
+
+    if (want == h->locking || h->shared) { // 공유 힙의 lock은 만들 때부터 끝까지 켜져 있음
+        return;
+    }
+    if (want) {
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&h->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        h->locking = 1;
+    } else {
+        h->locking = 0;
+        pthread_mutex_destroy(&h->lock);
+    }
+}
+
+// 여러 스레드가 한 힙을 같이 쓸 수 있게 공개 함수마다 lock을 잡게 함 (worker와는 따로 켜고 끔).
+// 켜고 끄는 동안에는 다른 스레드가 이 힙을 쓰면 안 됨. 이전 설정 반환 (공유 힙은 늘 1)
+int mm_heap_set_locking(mm_heap_t *h, int on) {
+    int old = h->shared || h->lock_user;
+
+    if (!h->shared) {
+        h->lock_user = (on != 0);
+        lock_update(h);
+    }
+    return old;
+}
+
+int mm_set_locking(int on) {
+    return mm_heap_set_locking(&default_heap, on);
+}
+
+// 버디 힙이면 버디 엔진으로 (lock은 같음)
+void *mm_heap_malloc(mm_heap_t *h, size_t size) {
+    void *bp;
+
+    HEAP_LOCK(h, NULL);
+    bp = (h->engine == MM_ENGINE_BUDDY) ? buddy_malloc(h, size) : heap_malloc(h, size);
+    HEAP_UNLOCK(h);
+    return bp;
+}
+
+void mm_heap_free(mm_heap_t *h, void *ptr) {
+    // worker가 돌고 있으면 큐에 넣고 바로 돌아감 (큐가 가득 차면 직접 해제).
+    // defer_users를 올린 뒤 defer_on을 다시 확인하므로, worker 정지(mm_heap_stop_worker)는
+    // defer_on을 끈 다음 defer_users가 0이 될 때까지만 기다리면 큐를 치워도 안전함
+    if (ptr != NULL && __atomic_load_n(&h->defer_on, __ATOMIC_RELAXED)) {
+        int queued;
+
+        __atomic_add_fetch(&h->defer_users, 1, __ATOMIC_SEQ_CST);
+        queued = __atomic_load_n(&h->defer_on, __ATOMIC_SEQ_CST) && defer_push(h, ptr) == 0;
+        __atomic_sub_fetch(&h->defer_users, 1, __ATOMIC_RELEASE);
+        if (queued) {
+            return;
+        }
+    }
+    HEAP_LOCK(h, );
+    if (h->engine == MM_ENGINE_BUDDY) {
+        buddy_free(h, ptr);
+    } else {
+        heap_free(h, ptr);
+    }
+    HEAP_UNLOCK(h);
+}
+
+void *mm_heap_realloc(mm_heap_t *h, void *ptr, size_t size) {
+    void *bp;
+
+    HEAP_LOCK(h, NULL);
+    bp = (h->engine == MM_ENGINE_BUDDY) ? buddy_realloc(h, ptr, size) : heap_realloc(h, ptr, size);
+    HEAP_UNLOCK(h);
+    return bp;
+}
+
+// align이 2의 거듭제곱이 아니면 NULL. 버디 블록의 페이로드는 BUDDY_HDR 뒤라서 ALIGNMENT까지만 맞춤
+void *mm_heap_memalign(mm_heap_t *h, size_t align, size_t size) {
+    void *bp;
+
+    if (align == 0 || (align & (align - 1)) != 0) {
+        return NULL;
+    }
+    HEAP_LOCK(h, NULL);
+    if (h->engine == MM_ENGINE_BUDDY) {
+        bp = (align <= ALIGNMENT) ? buddy_malloc(h, size) : NULL;
+    } else {
+        bp = heap_memalign(h, align, size);
+    }
+    HEAP_UNLOCK(h);
+    return bp;
+}
+
+// [ptr, ptr + size)가 힙 영역(세그먼트 포함) 안에 있으면 1. brk를 다른 스레드가 옮길 수 있으므로 lock 안에서 봄
+int mm_heap_contains(mm_heap_t *h, const void *ptr, size_t size) {
+    int in;
+
+    if (size == 0) {
+        return 1;
+    }
+    HEAP_LOCK(h, 0);
+    in = mem_region_contains(h->region, ptr, (const char *)ptr + size - 1);
+    HEAP_UNLOCK(h);
+    return in;
+}
+
+int mm_contains(const void *ptr, size_t size) {
+    return mm_heap_contains(&default_heap, ptr, size);
+}
+
+mm_handle_t mm_heap_halloc(mm_heap_t *h, size_t size) {
+    mm_handle_t handle;
+
+    HEAP_LOCK(h, 0);
+    handle = (h->engine == MM_ENGINE_BUDDY) ? 0 : heap_halloc(h, size); // 버디 블록은 옮길 수 없음
+    HEAP_UNLOCK(h);
+    return handle;
+}
+
+size_t mm_heap_compact(mm_heap_t *h) {
+    size_t trimmed;
+
+    HEAP_LOCK(h, 0);
+    trimmed = (h->engine == MM_ENGINE_BUDDY) ? 0 : heap_compact(h);
+    HEAP_UNLOCK(h);
+    return trimmed;
+}
+
+// --- 가용 페이지 반납 설정/실행 ---
+// ms: 가용 페이지를 이만큼 안 쓰면 돌려줌 (0이면 다음 확인 때 바로, 음수면 자동 반납 안 함)
+void mm_heap_set_decay(mm_heap_t *h, long ms) {
+    HEAP_LOCK(h, );
+    h->decay_ms = ms;
+    HEAP_UNLOCK(h);
+}
+
+// decay_ms가 지난 가용 페이지를 지금 돌려줌 (all이면 전부). 반납한 페이지 수 반환
+size_t mm_heap_purge(mm_heap_t *h, int all) {
+    size_t pages;
+
+    HEAP_LOCK(h, 0);
+    pages = decay_purge(h, all);
+    HEAP_UNLOCK(h);
+    return pages;
+}
+
+void mm_heap_purge_stats(mm_heap_t *h, mm_purge_stats_t *stats) {
+    HEAP_LOCK(h, );
+    *stats = h->purge_stats;
+    HEAP_UNLOCK(h);
+}
+
+void mm_set_decay(long ms) {
+    mm_heap_set_decay(&default_heap, ms);
+}
+
+size_t mm_purge(int all) {
+    return mm_heap_purge(&default_heap, all);
+}
+
+void mm_purge_stats(mm_purge_stats_t *stats) {
+    mm_heap_purge_stats(&default_heap, stats);
+}
 
-    // 4. 초기 가용 공간 확보를 위해 힙 확장 (CHUNKSIZE만큼)
-    if (extend_heap(CHUNKSIZE / WSIZE) == NULL) {
-        return -1; // 힙 확장 실패 시
+// --- 백그라운드 worker 시작/정지 ---
+// 실행 중에는 mm_heap_free가 큐에 넣기만 하고(lock 없음) 병합, 페이지 반납, hot bin 재선정은
+// worker가 wake_ms마다(또는 wake_batch개가 쌓이면) lock을 잡고 한꺼번에 함.
+// 공유 힙은 프로세스마다 스레드가 따로 돌게 되므로, 버디 힙은 worker가 분리 리스트 블록만 다루므로 지원하지 않음 (EINVAL)
+int mm_heap_start_worker(mm_heap_t *h, const mm_worker_config_t *config) {
+    size_t cap = WORKER_QUEUE;
+    size_t batch = 0;
+    long wake = WORKER_WAKE_MS;
+    pthread_condattr_t cattr;
+    defer_slot_t *slots;
+    int ret;
+
+    if (h->shared || h->parent != NULL || h->engine == MM_ENGINE_BUDDY || h->defer_slots != NULL) {
+        errno = EINVAL;
+        return -1;
     }
-    return 0; // 초기화 성공
+    if (config != NULL) {
+        if (config->wake_ms != 0) wake = config->wake_ms;
+        if (config->queue_cap != 0) cap = config->queue_cap;
+        batch = config->wake_batch;
+    }
+    if (cap > SIZE_MAX / (4 * sizeof(defer_slot_t))) {
+        errno = EINVAL;
+        return -1;
+    }
+    cap = (cap < 2) ? 2 : cap;
+    while (cap & (cap - 1)) { // 2의 거듭제곱으로 올림 (위치 계산을 마스크로)
+        cap = (cap | (cap - 1)) + 1;
+    }
+    if (batch == 0 || batch > cap) {
+        batch = cap / 2;
+    }
+    // 큐 필드는 malloc 쪽이 lock 안에서 읽으므로 lock_user가 켜져 있으면 lock 안에서 채움
+    HEAP_LOCK(h, -1);
+    if ((slots = meta_alloc(h, cap * sizeof(defer_slot_t))) == NULL) {
+        HEAP_UNLOCK(h);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (size_t i = 0; i < cap; i++) {
+        slots[i].seq = i;
+    }
+    h->defer_mask = cap - 1;
+    h->defer_enq = h->defer_deq = 0;
+    h->defer_batch = batch;
+    h->wake_ms = wake;
+    h->worker_stop = 0;
+    pthread_mutex_init(&h->worker_mx, NULL);
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&h->worker_cv, &cattr);
+    pthread_condattr_destroy(&cattr);
+    h->defer_slots = slots;
+    HEAP_UNLOCK(h);
+
+    // 이제부터 malloc 쪽과 worker가 겹치므로 공개 함수마다 lock을 잡음 (이미 켜져 있으면 그대로)
+    lock_update(h);
+    if ((ret = pthread_create(&h->worker, NULL, worker_main, h)) != 0) {
+        defer_teardown(h); // defer_on을 켜기 전이므로 큐에 넣는 스레드는 없음
+        errno = ret;
+        return -1;
+    }
+    __atomic_store_n(&h->defer_on, 1, __ATOMIC_RELEASE);
+    return 0;
 }
 
-// --- 힙 확장 ---
-// words: 확장할 크기 (워드 단위)
-static void *extend_heap(size_t words) {
-    char *bp;      // 새로 확장된 영역의 블록 포인터
-    size_t size;   // 실제 확장할 바이트 크기 (정렬됨)
+// 남은 free를 반영하고 큐와 worker용 mutex/cv를 치움 (worker 정지, 시작 실패 공용).
+// 큐에 넣는 스레드가 더 없을 때 부름. lock_user가 꺼져 있으면 lock도 다시 없앰
+static void defer_teardown(mm_heap_t *h) {
+    heap_lock(h); // meta 배열은 다른 스레드와 같이 쓰므로 lock 안에서
+    defer_drain(h, 0);
+    if (h->sketch_ticks >= SKETCH_PERIOD) { // worker가 미뤄 둔 재선정
+        update_hot_bins(h);
+        h->sketch_ticks = 0;
+    }
+    meta_release(h, h->defer_slots, (h->defer_mask + 1) * sizeof(defer_slot_t));
+    h->defer_slots = NULL;
+    pthread_mutex_unlock(&h->lock);
 
-    // 1. 요청 크기(words)를 짝수 워드로 만들고 바이트 단위로 변환 (8바이트 정렬 유지)
-    size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
+    pthread_cond_destroy(&h->worker_cv);
+    pthread_mutex_destroy(&h->worker_mx);
+    lock_update(h);
+}
 
-    // 2. mem_sbrk 시스템 콜로 힙 크기 늘림
-    if ((long)(bp = mem_sbrk(size)) == -1) {
-        return NULL; // 메모리 부족 시 실패
+// worker를 멈추고 큐에 남은 free를 반영함. lock_user가 꺼져 있으면 이후 힙은 다시 lock 없이
+// (한 스레드에서) 쓰므로, 그때는 다른 스레드가 이 힙을 다 쓴 뒤에 불러야 함 (mm.h 참고).
+// lock_user가 켜져 있으면 다른 스레드가 계속 malloc/free해도 됨
+void mm_heap_stop_worker(mm_heap_t *h) {
+    if (h->defer_slots == NULL) {
+        return;
     }
+    // 1. 새 free가 큐로 오지 않게 막고, 이미 defer_on을 보고 넣는 중인 스레드가 끝나길 기다림
+    __atomic_store_n(&h->defer_on, 0, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&h->defer_users, __ATOMIC_SEQ_CST) != 0) {
+        sched_yield();
+    }
+    pthread_mutex_lock(&h->worker_mx);
+    h->worker_stop = 1;
+    pthread_cond_signal(&h->worker_cv);
+    pthread_mutex_unlock(&h->worker_mx);
+    pthread_join(h->worker, NULL);
+
+    // 2. 남은 free를 반영하고 큐를 반납
+    defer_teardown(h);
+}
 
-    // 3. 새로 생긴 영역을 가용 블록으로 초기화
-    PUT(HDRP(bp), PACK(size, 0));             // 새 가용 블록 헤더 (크기 size, 가용 상태 0)
-    PUT(FTRP(bp), PACK(size, 0));             // 새 가용 블록 푸터 (크기 size, 가용 상태 0)
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));   // 새 에필로그 헤더 (원래 에필로그 헤더 위치 덮어씀)
+int mm_start_worker(const mm_worker_config_t *config) {
+    return mm_heap_start_worker(&default_heap, config);
+}
 
-    // 4. 만약 이전 블록이 가용 상태였다면, 새로 만든 블록과 병합
-    //    (extend_heap 직전의 블록이 free 상태일 수 있음)
-    return coalesce(bp); // 병합된 블록 (또는 원래 블록)의 포인터 반환
+void mm_stop_worker(void) {
+    mm_heap_stop_worker(&default_heap);
 }
 
-// --- 리스트 인덱스 계산 헬퍼 ---
-// 주어진 크기(size)가 어떤 분리 리스트에 속하는지 계산
-static int get_list_index(size_t size) {
-    int list_idx = 0;
-    // size를 2로 계속 나누면서 인덱스를 증가 (대략 로그 스케일)
-    // 예: size 1~2 -> idx 0, 3~4 -> idx 1, 5~8 -> idx 2 ...
-    // LISTLIMIT-1 까지만 계산 (마지막 리스트는 나머지 큰 블록들 모두 포함)
-    while ((list_idx < LISTLIMIT - 1) && (size > 1)) {
-        size >>= 1; // size = size / 2
-        list_idx++;
+// --- 지연 free 큐에 넣기 ---
+// 여러 스레드가 동시에 불러도 됨 (lock 없이 CAS 한 번). 큐가 가득 찼으면 -1
+static int defer_push(mm_heap_t *h, void *ptr) {
+    size_t pos = __atomic_load_n(&h->defer_enq, __ATOMIC_RELAXED);
+    defer_slot_t *slot;
+
+    for (;;) {
+        slot = &h->defer_slots[pos & h->defer_mask];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+        if (dif == 0) { // 빈 슬롯: 차지해 봄 (실패하면 pos가 최신 값으로 바뀜)
+            if (__atomic_compare_exchange_n(&h->defer_enq, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) { // 한 바퀴 전 항목이 아직 안 꺼내짐: 가득 참
+            return -1;
+        } else {
+            pos = __atomic_load_n(&h->defer_enq, __ATOMIC_RELAXED);
+        }
+    }
+    slot->ptr = ptr;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+    // 일정 개수마다 worker를 일찍 깨움. worker_mx를 쥐고 알려야 worker가 기다리기 직전에
+    // 보낸 신호를 놓치지 않음 (놓쳐도 다음 주기에는 처리되지만 그만큼 늦어짐)
+    if ((pos + 1) % h->defer_batch == 0) {
+        pthread_mutex_lock(&h->worker_mx);
+        pthread_cond_signal(&h->worker_cv);
+        pthread_mutex_unlock(&h->worker_mx);
     }
-    return list_idx;
+    return 0;
 }
 
-// --- 가용 블록 리스트에 노드 삽입 (크기 오름차순) ---
-// bp: 삽입할 가용 블록, size: 블록 크기
-static void insert_node(void *bp, size_t size) {
-    int list_idx = get_list_index(size); // 적절한 리스트 인덱스 찾기
-    void *search_ptr = segregated_free_lists[list_idx]; // 해당 리스트 시작점부터 탐색
-    void *insert_prev = NULL; // 삽입 위치의 이전 노드를 기억할 포인터
+// --- 지연 free 큐 비우기 ---
+// lock을 쥔 쪽에서만 부름. 넣기가 끝난 항목을 차례로 해제 (discard면 해제 없이 버림). 꺼낸 개수 반환
+static size_t defer_drain(mm_heap_t *h, int discard) {
+    size_t pos = h->defer_deq;
+    size_t n = 0;
 
-    // 1. 리스트 내에서 크기 순서에 맞는 삽입 위치 찾기
-    //    (현재 블록(bp)의 size보다 크거나 같은 블록을 만날 때까지 이동)
-    while ((search_ptr != NULL) && (size > GET_SIZE(HDRP(search_ptr)))) {
-        insert_prev = search_ptr;
-        search_ptr = SUCC_PTR(search_ptr); // 다음 노드로
-    }
+    for (;;) {
+        defer_slot_t *slot = &h->defer_slots[pos & h->defer_mask];
+        void *ptr;
 
-    // 2. 찾은 위치에 bp 삽입 (4가지 경우 처리 - 리스트 맨 앞, 중간, 맨 뒤, 빈 리스트)
-    if (search_ptr != NULL) { // 중간 또는 맨 앞에 삽입
-        if (insert_prev != NULL) { // 중간 삽입 (insert_prev와 search_ptr 사이)
-            SUCC_PTR(bp) = search_ptr;
-            PRED_PTR(bp) = insert_prev;
-            PRED_PTR(search_ptr) = bp;
-            SUCC_PTR(insert_prev) = bp;
-        } else { // 맨 앞에 삽입 (list_head가 search_ptr)
-            SUCC_PTR(bp) = search_ptr;
-            PRED_PTR(bp) = NULL;
-            PRED_PTR(search_ptr) = bp;
-            segregated_free_lists[list_idx] = bp; // 리스트 헤드 변경
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            break; // 비었거나 아직 넣는 중
         }
-    } else { // 맨 뒤 또는 빈 리스트에 삽입
-        if (insert_prev != NULL) { // 맨 뒤 삽입 (insert_prev 다음)
-            SUCC_PTR(bp) = NULL;
-            PRED_PTR(bp) = insert_prev;
-            SUCC_PTR(insert_prev) = bp;
-        } else { // 빈 리스트에 삽입 (list_head가 NULL)
-            SUCC_PTR(bp) = NULL;
-            PRED_PTR(bp) = NULL;
-            segregated_free_lists[list_idx] = bp; // 리스트 헤드 변경
+        ptr = slot->ptr;
+        __atomic_store_n(&slot->seq, pos + h->defer_mask + 1, __ATOMIC_RELEASE); // 다음 바퀴에 넣을 차례
+        pos++;
+        n++;
+        h->defer_deq = pos;
+        if (!discard) {
+            heap_free(h, ptr);
         }
     }
+    return n;
 }
 
-// --- 가용 블록 리스트에서 노드 삭제 ---
-// bp: 삭제할 가용 블록
-static void delete_node(void *bp) {
-    int list_idx = get_list_index(GET_SIZE(HDRP(bp))); // 해당 리스트 인덱스 찾기
-    void *prev_fp = PRED_PTR(bp); // 삭제할 노드의 이전 노드
-    void *next_fp = SUCC_PTR(bp); // 삭제할 노드의 다음 노드
+// --- worker 스레드 ---
+// wake_ms마다 (또는 defer_push가 깨우면) 힙 lock을 잡고 밀린 일을 처리
+static void *worker_main(void *arg) {
+    mm_heap_t *h = arg;
+    struct timespec ts;
+
+    pthread_mutex_lock(&h->worker_mx);
+    while (!h->worker_stop) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += h->wake_ms / 1000;
+        ts.tv_nsec += (h->wake_ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&h->worker_cv, &h->worker_mx, &ts);
+        if (h->worker_stop) {
+            break;
+        }
+        pthread_mutex_unlock(&h->worker_mx);
 
-    // 이전 노드 처리
-    if (prev_fp == NULL) { // 삭제할 노드가 리스트의 헤드인 경우
-        segregated_free_lists[list_idx] = next_fp; // 리스트 헤드를 다음 노드로 변경
-    } else { // 삭제할 노드가 중간 또는 꼬리인 경우
-        SUCC_PTR(prev_fp) = next_fp; // 이전 노드가 다음 노드를 가리키도록 변경
+        heap_lock(h);
+        defer_drain(h, 0);                 // 1. 밀린 free: 병합 + 가용 리스트 등록
+        if (h->decay_head != NULL) {
+            decay_purge(h, 0);             // 2. 오래된 가용 페이지 반납
+        }
+        if (h->sketch_ticks >= SKETCH_PERIOD) {
+            update_hot_bins(h);            // 3. hot bin 재선정
+            h->sketch_ticks = 0;
+        }
+        pthread_mutex_unlock(&h->lock);
+
+        pthread_mutex_lock(&h->worker_mx);
     }
+    pthread_mutex_unlock(&h->worker_mx);
+    return NULL;
+}
 
-    // 다음 노드 처리 (삭제할 노드가 꼬리가 아닌 경우)
-    if (next_fp != NULL) {
-        PRED_PTR(next_fp) = prev_fp; // 다음 노드가 이전 노드를 가리키도록 변경
+// --- 핸들 API (기본 힙) ---
+mm_handle_t mm_halloc(size_t size) {
+    return mm_heap_halloc(&default_heap, size);
+}
+
+void mm_hfree(mm_handle_t handle) {
+    mm_heap_hfree(&default_heap, handle);
+}
+
+void *mm_hlock(mm_handle_t handle) {
+    return mm_heap_hlock(&default_heap, handle);
+}
+
+void mm_hunlock(mm_handle_t handle) {
+    mm_heap_hunlock(&default_heap, handle);
+}
+
+size_t mm_compact(void) {
+    return mm_heap_compact(&default_heap);
+}
+
+// --- 핸들 항목 찾기 ---
+// 잘못된 핸들(범위 밖이거나 이미 해제됨)이면 NULL
+static handle_entry_t *handle_entry(mm_heap_t *h, mm_handle_t handle) {
+    if (handle == 0 || handle > h->handle_used || h->handles[handle - 1].bp == NULL) {
+        return NULL;
     }
-    // bp 내부의 PRED/SUCC 포인터는 이제 업데이트할 필요 없음 (어차피 사용 안 함)
+    return &h->handles[handle - 1];
 }
 
-// --- 인접 가용 블록 병합 (Dispatcher 역할) ---
-// bp: 현재 (막 해제되었거나 새로 생성된) 가용 블록
-static void *coalesce(void *bp) {
-    // 이전/다음 블록 정보 확인
-    void *prev_footer = FTRP(PREV_BLKP(bp)); // 이전 블록 푸터 (정확히는 bp 시작 - DSIZE)
-    void *next_header = HDRP(NEXT_BLKP(bp)); // 다음 블록 헤더
-    size_t prev_alloc = GET_ALLOC(prev_footer); // 이전 블록 할당 상태
-    size_t next_alloc = GET_ALLOC(next_header); // 다음 블록 할당 상태
-    size_t size = GET_SIZE(HDRP(bp));           // 현재 블록 크기
+// --- 핸들 테이블 확보 ---
+// 테이블이 cap개 이상의 항목을 담도록 두 배씩 늘림. 새 항목은 0(빈 항목)으로 채워짐
+static int handle_reserve(mm_heap_t *h, size_t cap) {
+    size_t newcap = h->handle_cap ? h->handle_cap : INDEX_INIT_CAP;
+    handle_entry_t *t;
 
-    // 이전/다음 블록의 할당 상태에 따라 4가지 경우로 나누어 처리
-    if (prev_alloc && next_alloc) {         // Case 1: 둘 다 할당됨 (병합 없음)
-        return coalesce_case1(bp, size);
+    if (cap <= h->handle_cap) {
+        return 0;
     }
-    else if (prev_alloc && !next_alloc) { // Case 2: 다음 블록만 가용
-        void *next_bp = NEXT_BLKP(bp);
-        size_t next_size = GET_SIZE(HDRP(next_bp));
-        return coalesce_case2(bp, size, next_bp, next_size);
+    while (newcap < cap) {
+        newcap *= 2;
     }
-    else if (!prev_alloc && next_alloc) { // Case 3: 이전 블록만 가용
-        void *prev_bp = PREV_BLKP(bp);
-        size_t prev_size = GET_SIZE(HDRP(prev_bp)); // 이전 블록 헤더에서 크기 읽기
-        return coalesce_case3(bp, size, prev_bp, prev_size);
+    if ((t = meta_alloc(h, newcap * sizeof(handle_entry_t))) == NULL) {
+        return -1;
     }
-    else {                                // Case 4: 둘 다 가용
-        void *prev_bp = PREV_BLKP(bp);
-        void *next_bp = NEXT_BLKP(bp);
-        size_t prev_size = GET_SIZE(HDRP(prev_bp));
-        size_t next_size = GET_SIZE(HDRP(next_bp));
-        return coalesce_case4(bp, size, prev_bp, prev_size, next_bp, next_size);
+    if (h->handle_cap != 0) {
+        memcpy(t, h->handles, h->handle_used * sizeof(handle_entry_t));
+        meta_release(h, h->handles, h->handle_cap * sizeof(handle_entry_t));
     }
+    h->handles = t;
+    h->handle_cap = newcap;
+    return 0;
 }
 
-// --- Coalesce Helper: Case 1 (병합 없음) ---
-static void *coalesce_case1(void *bp, size_t size) {
-    // 현재 블록(bp)을 가용 리스트에 삽입하기만 함
-    insert_node(bp, size);
-    return bp; // 현재 블록 포인터 반환
+// --- 핸들 할당 ---
+// 앞에 핸들 번호를 담을 HANDLE_PREFIX 바이트를 붙여 힙 본체에서 할당하고 푸터에 HANDLE_TAG 표시.
+// 실패하면 0
+static mm_handle_t heap_halloc(mm_heap_t *h, size_t size) {
+    size_t id;
+
+    // 1. 빈 항목 확보 (없으면 테이블을 늘림)
+    if (h->handle_free != 0) {
+        id = h->handle_free - 1;
+        h->handle_free = h->handles[id].next;
+    } else {
+        if (handle_reserve(h, h->handle_used + 1) < 0) {
+            return 0;
+        }
+        id = h->handle_used++;
+    }
+
+    // 2. 블록 할당 후 표시
+    char *bp = mm_heap_malloc(h, size + HANDLE_PREFIX);
+    if (bp == NULL) {
+        h->handles[id].bp = NULL;
+        h->handles[id].next = h->handle_free;
+        h->handle_free = id + 1;
+        return 0;
+    }
+    PUT(FTRP(bp), GET(FTRP(bp)) | HANDLE_TAG);
+    *(size_t *)bp = id;
+    h->handles[id].bp = bp;
+    h->handles[id].locks = 0;
+    return id + 1;
 }
 
-// --- Coalesce Helper: Case 2 (다음 블록과 병합) ---
-static void *coalesce_case2(void *bp, size_t size, void* next_bp, size_t next_size) {
-    delete_node(next_bp);          // 다음 블록을 리스트에서 제거
-    size += next_size;             // 크기 합산
-    PUT(HDRP(bp), PACK(size, 0));  // 현재 블록 헤더 업데이트
-    PUT(FTRP(bp), PACK(size, 0));  // 현재 블록 푸터 업데이트 (새 크기 기준)
-    insert_node(bp, size);         // 병합된 블록을 리스트에 삽입
-    return bp;                     // 병합된 블록 시작(bp) 반환
+// --- 핸들 해제 ---
+void mm_heap_hfree(mm_heap_t *h, mm_handle_t handle) {
+    handle_entry_t *e;
+
+    HEAP_LOCK(h, );
+    if ((e = handle_entry(h, handle)) != NULL) {
+        heap_free(h, e->bp);
+        e->bp = NULL;
+        e->next = h->handle_free;
+        h->handle_free = handle;
+    }
+    HEAP_UNLOCK(h);
 }
 
-// --- Coalesce Helper: Case 3 (이전 블록과 병합) ---
-static void *coalesce_case3(void *bp, size_t size, void* prev_bp, size_t prev_size) {
-    delete_node(prev_bp);          // 이전 블록을 리스트에서 제거
-    size += prev_size;             // 크기 합산
-    PUT(HDRP(prev_bp), PACK(size, 0)); // 이전 블록 헤더 업데이트
-    PUT(FTRP(bp), PACK(size, 0));     // *현재 블록의 푸터* 위치에 새 크기로 업데이트
-    insert_node(prev_bp, size);    // 병합된 블록을 리스트에 삽입
-    return prev_bp;                // 병합된 블록 시작(prev_bp) 반환
+// --- 핸들 고정 ---
+// 블록을 고정하고 현재 페이로드 주소를 반환. mm_hunlock 전까지는 mm_compact가 옮기지 않음
+void *mm_heap_hlock(mm_heap_t *h, mm_handle_t handle) {
+    handle_entry_t *e;
+    void *p = NULL;
+
+    HEAP_LOCK(h, NULL);
+    if ((e = handle_entry(h, handle)) != NULL) {
+        e->locks++;
+        p = (char *)e->bp + HANDLE_PREFIX;
+    }
+    HEAP_UNLOCK(h);
+    return p;
 }
 
-// --- Coalesce Helper: Case 4 (양쪽 블록과 병합) ---
-static void *coalesce_case4(void *bp, size_t size, void* prev_bp, size_t prev_size, void* next_bp, size_t next_size) {
-    delete_node(prev_bp);          // 이전 블록 제거
-    delete_node(next_bp);          // 다음 블록 제거
-    size += prev_size + next_size; // 세 블록 크기 합산
-    PUT(HDRP(prev_bp), PACK(size, 0)); // 이전 블록 헤더 업데이트
-    PUT(FTRP(next_bp), PACK(size, 0)); // *다음 블록의 푸터* 위치에 새 크기로 업데이트
-    insert_node(prev_bp, size);    // 병합된 블록을 리스트에 삽입
-    return prev_bp;                // 병합된 블록 시작(prev_bp) 반환
+// --- 핸들 고정 해제 ---
+void mm_heap_hunlock(mm_heap_t *h, mm_handle_t handle) {
+    handle_entry_t *e;
+
+    HEAP_LOCK(h, );
+    if ((e = handle_entry(h, handle)) != NULL && e->locks > 0) {
+        e->locks--;
+    }
+    HEAP_UNLOCK(h);
 }
 
+// --- 힙 압축 ---
+// 힙을 앞에서부터 훑으며 고정되지 않은 핸들 블록을 앞쪽 빈 공간(gap)으로 밀어 붙이고
+// 핸들 테이블을 고침. 옮길 수 없는 블록을 만나면 그 앞의 gap은 가용 블록 하나가 됨.
+// 마지막에 남은 gap은 힙에서 잘라 memlib에 돌려줌. 잘라낸 바이트 수를 반환.
+static size_t heap_compact(mm_heap_t *h) {
+    char *bp;
+    char *gap = NULL; // 아직 기록하지 않은 빈 공간의 시작 (블록 포인터 기준)
+    size_t size;
+
+    if (h->parent != NULL) return 0; // nursery 청크 안의 블록은 핸들 블록이 아님
+
+    // 옮긴 블록은 항상 지금 보는 블록보다 앞쪽에 쓰이므로 다음 블록 헤더는 그대로 남아 있음
+    for (bp = h->first_bp; (size = GET_SIZE(HDRP(bp))) != 0; bp += size) {
+        if (!GET_ALLOC(HDRP(bp))) { // 가용 블록: 리스트에서 빼고 gap에 합침
+            delete_node(h, bp);
+            if (gap == NULL) gap = bp;
+            continue;
+        }
+        if (gap == NULL) continue;
+
+        handle_entry_t *e = NULL;
+        if (GET(FTRP(bp)) & HANDLE_TAG) {
+            e = &h->handles[*(size_t *)bp];
+        }
+        if (e != NULL && e->locks == 0) { // 옮길 수 있는 블록: 헤더~푸터를 통째로 gap으로
+            if (h->purge_stats.released != 0) {
+                purge_touch(h, HDRP(gap), HDRP(gap) + size, 1);
+            }
+            memmove(HDRP(gap), HDRP(bp), size);
+            e->bp = gap;
+            gap += size;
+        } else { // 옮길 수 없는 블록: 앞의 gap을 가용 블록으로 기록
+            make_free_block(h, gap, bp - gap);
+            gap = NULL;
+        }
+    }
+
+    // 힙 끝까지 gap이면 그 자리에 에필로그를 세우고 나머지를 잘라냄
+    if (gap == NULL) return 0;
+    size = bp - gap;
+    if (h->purge_stats.released != 0) { // 잘라낸 페이지는 더 이상 반납 상태가 아님
+        purge_touch(h, HDRP(gap), HDRP(bp) + WSIZE, 0);
+    }
+    PUT(HDRP(gap), PACK(0, 1));
+    mem_region_trim(h->region, size);
+    return size;
+}
 
 // --- 메모리 할당 ---
-void *mm_malloc(size_t size) {
+static void *heap_malloc(mm_heap_t *h, size_t size) {
     size_t asize;      // 실제 할당할 블록 크기 (오버헤드 + 정렬)
     size_t extendsize; // 힙 확장 시 크기
     void *bp = NULL;   // 찾거나 할당된 블록 포인터
@@ -282,42 +2520,134 @@ void *mm_malloc(size_t size) {
     if (size == 0) return NULL; // 요청 크기 0이면 NULL
 
     // 1. 실제 필요한 크기(asize) 계산
-    if (size <= (2 * DSIZE)) { // 요청 페이로드가 작으면(16바이트 이하)
-        asize = MIN_BLOCK_SIZE; // 최소 블록 크기(24바이트) 할당 (포인터 저장 공간 확보)
-    } else {
-        // 헤더/푸터(DSIZE) 추가하고 8바이트 정렬
-        asize = ALIGN(size + DSIZE);
+    if ((asize = adjust_size(size)) == 0) return NULL; // 표현할 수 없을 만큼 큰 요청
+
+    // 요청 크기 빈도 기록 (hot bin 선정용)
+    if (h->hot_bins) {
+        sketch_record(h, asize);
     }
 
     // 2. 가용 리스트에서 적합한 블록 검색 (First Fit)
-    if ((bp = find_fit(asize)) != NULL) {
-        place(bp, asize); // 블록 배치(할당 및 분할)
-        return bp;        // 할당된 블록의 페이로드 시작 주소 반환
+    if ((bp = find_fit(h, asize)) != NULL) {
+        return place(h, bp, asize); // 블록 배치(할당 및 분할) 후 페이로드 시작 주소 반환
+    }
+
+    // 큐에 쌓인 free가 있으면 먼저 반영해 보고 다시 검색
+    if (h->defer_slots != NULL && defer_drain(h, 0) > 0 && (bp = find_fit(h, asize)) != NULL) {
+        return place(h, bp, asize);
     }
 
     // 3. 적합한 블록 없으면 힙 확장
-    extendsize = MAX(asize, CHUNKSIZE); // 요청 크기와 CHUNKSIZE 중 큰 값으로 확장
-    if ((bp = extend_heap(extendsize / WSIZE)) == NULL) {
+    extendsize = MAX(asize, h->chunk); // 요청 크기와 청크 크기 중 큰 값으로 확장
+    if ((bp = extend_heap(h, extendsize / WSIZE)) == NULL) {
         return NULL; // 힙 확장 실패
     }
-    place(bp, asize); // 새로 확장된 공간에 블록 배치
-    return bp;
+    return place(h, bp, asize); // 새로 확장된 공간에 블록 배치
+}
+
+// --- 정렬 할당 ---
+// align(2의 거듭제곱) 경계에 페이로드가 놓이는 블록. 정렬 여유만큼 더 크게 할당한 뒤
+// 경계 앞부분과 쓰고 남는 뒷부분을 잘라 가용 블록으로 돌려줌
+static void *heap_memalign(mm_heap_t *h, size_t align, size_t size) {
+    size_t asize, csize, lead;
+    char *bp, *p;
+
+    if (align <= ALIGNMENT) {
+        return heap_malloc(h, size);
+    }
+    if (size == 0 || (asize = adjust_size(size)) == 0 || align > MAX_BLOCK_SIZE - asize) {
+        return NULL;
+    }
+    // 앞 조각도 최소 블록 크기는 되어야 하므로 align + MIN_BLOCK_SIZE만큼 여유
+    if ((bp = heap_malloc(h, asize + align + MIN_BLOCK_SIZE - DSIZE)) == NULL) {
+        return NULL;
+    }
+    csize = GET_SIZE(HDRP(bp));
+
+    // 1. 앞쪽: 경계까지의 조각이 최소 블록보다 작으면 다음 경계로
+    p = (char *)(((uintptr_t)bp + align - 1) & ~(uintptr_t)(align - 1));
+    if (p != bp && (size_t)(p - bp) < MIN_BLOCK_SIZE) {
+        p += align;
+    }
+    lead = (size_t)(p - bp);
+    if (!SIZE_FITS(csize - lead)) { // 4GB 넘는 블록은 4KB 배수로만 자를 수 있음
+        heap_free(h, bp);
+        return NULL;
+    }
+    if (lead != 0) {
+        PUT(HDRP(bp), PACK(lead, 1 | ALLOC_TAG(h)));
+        PUT(FTRP(bp), PACK(lead, 1 | ALLOC_TAG(h)));
+        PUT(HDRP(p), PACK(csize - lead, 1 | ALLOC_TAG(h)));
+        PUT(FTRP(p), PACK(csize - lead, 1 | ALLOC_TAG(h)));
+        heap_free(h, bp); // 앞 가용 블록과 병합됨
+        csize -= lead;
+    }
+
+    // 2. 뒤쪽: 분할 기준 이상 남으면 떼어 내 뒤 가용 블록과 병합
+    if (csize - asize >= h->split_min && SIZE_FITS(csize - asize)) {
+        PUT(HDRP(p), PACK(asize, 1 | ALLOC_TAG(h)));
+        PUT(FTRP(p), PACK(asize, 1 | ALLOC_TAG(h)));
+        PUT(HDRP(p + asize), PACK(csize - asize, 1 | ALLOC_TAG(h)));
+        PUT(FTRP(p + asize), PACK(csize - asize, 1 | ALLOC_TAG(h)));
+        heap_free(h, p + asize);
+    }
+    return p;
+}
+
+// --- 요청 크기 → 블록 크기 변환 ---
+// size: 사용자 요청 바이트 수. 헤더/푸터를 더하고 정렬한 블록 크기 반환 (불가능하면 0)
+static size_t adjust_size(size_t size) {
+    if (size > MAX_BLOCK_SIZE - LARGE_UNIT) {
+        return 0; // 헤더에 담을 수 없는 크기 (오버플로 방지)
+    }
+    if (size <= MIN_BLOCK_SIZE - DSIZE) { // 요청 페이로드가 작으면(64비트 16바이트, 32비트 8바이트 이하)
+        return MIN_BLOCK_SIZE; // 최소 블록 크기 할당 (포인터 저장 공간 확보)
+    }
+    // 헤더/푸터(DSIZE) 추가하고 ALIGNMENT 배수로 정렬
+    size_t asize = ALIGN(size + DSIZE);
+    // 4GB를 넘는 블록은 4KB 배수로 올림 (큰 블록 인코딩 조건)
+    if (!SIZE_FITS(asize)) {
+        asize = (asize + LARGE_UNIT - 1) & ~(LARGE_UNIT - 1);
+    }
+    return asize;
 }
 
 // --- 적합한 가용 블록 찾기 (First Fit) ---
 // asize: 필요한 블록 크기 (정렬됨)
-static void *find_fit(size_t asize) {
-    int list_idx = get_list_index(asize); // 검색 시작할 리스트 인덱스
-    void *bp;
+static void *find_fit(mm_heap_t *h, size_t asize) {
+    int list_idx = get_list_index(h, asize); // 검색 시작할 리스트 인덱스
+
+    // 0. hot 크기면 정확 크기 bin에서 O(1)로 꺼냄 (분할 없음)
+    for (int i = 0; i < HOT_BINS; i++) {
+        if (h->hot_bin_size[i] == asize && h->hot_bin_lists[i] != NULL) {
+            return h->hot_bin_lists[i];
+        }
+    }
 
-    // 해당 크기 클래스 리스트부터 시작해서 더 큰 크기의 리스트까지 순차 탐색
-    for (; list_idx < LISTLIMIT; list_idx++) {
-        // 현재 리스트 내의 블록들을 순회
-        for (bp = segregated_free_lists[list_idx]; bp != NULL; bp = SUCC_PTR(bp)) {
-            // 현재 블록 크기가 요청 크기(asize)보다 크거나 같으면
-            if (GET_SIZE(HDRP(bp)) >= asize) {
-                return bp; // 첫 번째로 찾은 블록 반환 (First Fit)
+    // 해당 크기 클래스 인덱스부터 시작해서 더 큰 크기의 클래스까지 순차 탐색
+    uint32_t target = SIZE_KEY(asize);
+    for (; list_idx < h->classes; list_idx++) {
+        size_index_t *ix = &h->seg_index[list_idx];
+        if (ix->n == 0) continue;
+        if (target == UINT32_MAX) { // 32GB 이상: 키가 포화되므로 헤더의 실제 크기로 비교
+            for (size_t j = 0; j < ix->n; j++) {
+                if (ix->key[j] == UINT32_MAX && GET_SIZE(HDRP(ix->blk[j])) >= asize) {
+                    return ix->blk[j];
+                }
             }
+            continue;
+        }
+        // 클래스 안에서 asize 이상인 가장 작은 블록 (SIMD로 키 배열만 훑음)
+        size_t pos = index_search(ix->key, ix->n, target);
+        if (pos < ix->n) {
+            return ix->blk[pos];
+        }
+    }
+
+    // 분리 리스트에 없으면 힙 확장 전에 더 큰 크기의 hot bin 블록이라도 사용
+    for (int i = 0; i < HOT_BINS; i++) {
+        if (h->hot_bin_size[i] >= asize && h->hot_bin_lists[i] != NULL) {
+            return h->hot_bin_lists[i];
         }
     }
     return NULL; // 모든 리스트를 다 찾아도 없으면 NULL 반환
@@ -325,37 +2655,113 @@ static void *find_fit(size_t asize) {
 
 // --- 블록 할당 및 분할 ---
 // bp: find_fit으로 찾은 가용 블록, asize: 할당할 크기
-static void place(void *bp, size_t asize) {
+static void *place(mm_heap_t *h, void *bp, size_t asize) {
     size_t csize = GET_SIZE(HDRP(bp)); // 찾은 가용 블록의 전체 크기
 
     // 1. 이 블록은 이제 할당될 것이므로 가용 리스트에서 제거
-    delete_node(bp);
+    delete_node(h, bp);
+
+    // 4GB 넘는 블록에서 작은 블록을 떼면 나머지가 4KB 배수가 아니라 헤더에 못 담음.
+    // 이 경우 앞쪽을 작은 인코딩 범위의 가장 큰 4KB 배수만큼만 남기고 뒤는 따로 가용 블록으로 돌려줌.
+    if (!SIZE_FITS(csize - asize)) {
+        size_t front = SMALL_MAX & ~(LARGE_UNIT - 1);
+        make_free_block(h, (char *)bp + front, csize - front);
+        csize = front;
+    }
+    char *start = HDRP(bp);      // 이 블록이 차지하던 범위 (반납 페이지 확인용)
+    char *limit = start + csize;
+
+    // 캐시 라인보다 작은 요청은 페이로드가 라인 경계를 넘지 않는 위치로 옮겨 배치.
+    // 앞쪽에 남는 부분은 가용 블록으로 돌려줌 (이전 블록은 할당 상태이므로 병합할 필요 없음)
+    size_t lead = h->line_place ? line_lead(bp, csize, asize) : 0;
+    if (lead != 0) {
+        PUT(HDRP(bp), PACK(lead, 0));
+        PUT(FTRP(bp), PACK(lead, 0));
+        insert_node(h, bp, lead);
+        bp = (char *)bp + lead;
+        csize -= lead;
+    }
+
+    // 큰 요청은 가용 블록 뒤쪽에서 잘라 내고 앞쪽을 가용 블록으로 남김. 작은 블록은 앞쪽,
+    // 큰 블록은 뒤쪽에 모이므로 작은 블록들이 해제돼도 큰 블록 사이에 쓸모없는 틈이 덜 생김.
+    // 이미 캐시 라인에 맞춰 옮긴 블록(lead != 0)은 다시 옮기지 않음
+    if (lead == 0 && h->tail_min != 0 && asize >= h->tail_min && csize - asize >= h->split_min) {
+        size_t front = csize - asize;
+        PUT(HDRP(bp), PACK(front, 0));
+        PUT(FTRP(bp), PACK(front, 0));
+        insert_node(h, bp, front);
+        bp = (char *)bp + front;
+        csize = asize;
+        start = (char *)bp - DSIZE; // 앞 가용 블록의 머리는 원래 블록의 머리 그대로이고 푸터부터 새로 씀
+    }
 
-    // 2. 블록 분할 결정: 남는 공간이 최소 블록 크기 이상인가?
-    if ((csize - asize) >= MIN_BLOCK_SIZE) {
+    // 2. 블록 분할 결정: 남는 공간이 분할 기준(최소 블록 크기 이상) 이상인가?
+    if ((csize - asize) >= h->split_min) {
         // 분할 수행
         // a) 앞부분: asize만큼 할당 상태로 설정
-        PUT(HDRP(bp), PACK(asize, 1));
-        PUT(FTRP(bp), PACK(asize, 1));
+        PUT(HDRP(bp), PACK(asize, 1 | ALLOC_TAG(h)));
+        PUT(FTRP(bp), PACK(asize, 1 | ALLOC_TAG(h)));
         // b) 뒷부분: 나머지(csize - asize)는 새로운 가용 블록으로 설정
         void *next_bp = NEXT_BLKP(bp); // 나머지 블록 시작점
         size_t remainder_size = csize - asize;
         PUT(HDRP(next_bp), PACK(remainder_size, 0));
         PUT(FTRP(next_bp), PACK(remainder_size, 0));
         // c) 새로 생긴 가용 블록(next_bp)을 가용 리스트에 추가
-        insert_node(next_bp, remainder_size); // 정렬된 위치에 삽입
+        insert_node(h, next_bp, remainder_size); // 정렬된 위치에 삽입
     }
     // 3. 분할하지 않는 경우: 블록 전체를 할당 상태로 설정
     else {
-        PUT(HDRP(bp), PACK(csize, 1));
-        PUT(FTRP(bp), PACK(csize, 1));
+        PUT(HDRP(bp), PACK(csize, 1 | ALLOC_TAG(h)));
+        PUT(FTRP(bp), PACK(csize, 1 | ALLOC_TAG(h)));
+    }
+
+    // 4. 반납했던 페이지를 다시 쓰게 되면 (새 블록, 뒤에 남은 가용 블록의 머리) 새 페이지 폴트로 셈
+    if (h->purge_stats.released != 0) {
+        char *end = (char *)bp + asize + DECAY_HEAD;
+        purge_touch(h, start, end < limit ? end : limit, 1);
+    }
+    return bp;
+}
+
+// --- 캐시 라인 인식 배치 위치 ---
+// 가용 블록 bp(크기 csize)에 asize 블록을 놓을 때 앞에 남겨 둘 가용 블록 크기 (0이면 맨 앞에 배치).
+// 페이로드가 캐시 라인 하나에 들어갈 수 있는데 맨 앞에 놓으면 경계를 넘는 경우에만,
+// 잘린 조각이 모두 최소 블록 크기 이상이 되는 위치를 고름. 조각이 하나만 생기는
+// 블록 끝 배치를 먼저 보고, 안 되면 다음 라인 경계(조각이 너무 작으면 그다음 경계)에 맞춤.
+static size_t line_lead(void *bp, size_t csize, size_t asize) {
+    size_t psize = asize - DSIZE; // 페이로드 크기
+    size_t off = (uintptr_t)bp & (CACHE_LINE - 1);
+    size_t lead;
+
+    if (psize > CACHE_LINE || off + psize <= CACHE_LINE || csize - asize < MIN_BLOCK_SIZE) {
+        return 0; // 큰 요청이거나, 이미 한 라인 안이거나, 옮길 여유가 없음
+    }
+
+    // 1. 블록 끝에 붙이기: 앞쪽 나머지 하나만 생김
+    lead = csize - asize;
+    if ((((uintptr_t)bp + lead) & (CACHE_LINE - 1)) + psize <= CACHE_LINE) {
+        return lead;
     }
+
+    // 2. 다음 라인 경계에 맞추기: 앞뒤로 조각이 생기므로 둘 다 최소 블록 크기 이상이어야 함
+    for (lead = CACHE_LINE - off; lead < CACHE_LINE + MIN_BLOCK_SIZE; lead += CACHE_LINE) {
+        if (lead < MIN_BLOCK_SIZE) continue;
+        if (lead + asize > csize) break;
+        size_t rest = csize - lead - asize;
+        if (rest == 0 || rest >= MIN_BLOCK_SIZE) {
+            return lead;
+        }
+    }
+    return 0; // 적당한 자리가 없으면 그냥 맨 앞 (경계를 넘더라도)
 }
 
 // --- 메모리 해제 ---
 // bp: 해제할 블록 포인터
-void mm_free(void *bp) {
+static void heap_free(mm_heap_t *h, void *bp) {
     if (bp == NULL) return; // NULL 포인터 해제 시 무시
+    if ((GET(HDRP(bp)) & SHORT_TAG) && h->nursery != NULL) {
+        h = h->nursery; // 단명 블록은 nursery가 관리
+    }
 
     size_t size = GET_SIZE(HDRP(bp)); // 블록 크기 확인
 
@@ -364,26 +2770,45 @@ void mm_free(void *bp) {
     PUT(FTRP(bp), PACK(size, 0));
 
     // 인접 블록과 병합 시도 및 가용 리스트에 추가
-    coalesce(bp);
+    bp = coalesce(h, bp);
+
+    // 가끔 시계를 보고 오래 쓰이지 않은 가용 페이지를 OS에 돌려줌
+    if (h->decay_head != NULL && ++h->decay_ticks >= DECAY_TICKS) {
+        h->decay_ticks = 0;
+        decay_purge(h, 0);
+    }
+
+    // 세그먼트가 통째로 비었으면 (양옆이 프롤로그/에필로그인데 영역의 첫 블록은 아님) 반납
+    if (h->parent == NULL && bp != h->first_bp && GET((char *)bp - DSIZE) == PACK(DSIZE, 1)
+        && GET(HDRP(NEXT_BLKP(bp))) == PACK(0, 1)) {
+        segment_release(h, bp);
+        return;
+    }
+
+    // nursery 청크가 통째로 비었으면 (양옆이 청크의 프롤로그/에필로그) 부모에게 반납
+    if (h->parent != NULL && GET((char *)bp - DSIZE) == PACK(DSIZE, 1)
+        && GET(HDRP(NEXT_BLKP(bp))) == PACK(0, 1)) {
+        delete_node(h, bp);
+        heap_free(h->parent, (char *)bp - 2 * DSIZE);
+    }
 }
 
 // --- 메모리 재할당 (Dispatcher 역할) ---
 // ptr: 재할당할 메모리 블록, size: 새로운 요청 데이터 크기
-void *mm_realloc(void *ptr, size_t size) {
+static void *heap_realloc(mm_heap_t *h, void *ptr, size_t size) {
     // 특별한 경우 처리
-    if (ptr == NULL) return mm_malloc(size); // ptr이 NULL이면 malloc과 동일
-    if (size == 0) { mm_free(ptr); return NULL; } // size가 0이면 free와 동일
+    if (ptr == NULL) return mm_heap_malloc(h, size); // ptr이 NULL이면 malloc과 동일
+    if ((GET(HDRP(ptr)) & SHORT_TAG) && h->nursery != NULL) {
+        h = h->nursery; // 단명 블록은 nursery 안에서 키우거나 옮김
+    }
+    if (size == 0) { mm_heap_free(h, ptr); return NULL; } // size가 0이면 free와 동일
 
     void *oldptr = ptr;
     size_t oldsize = GET_SIZE(HDRP(oldptr)); // 원래 블록의 전체 크기
     size_t newsize; // 새로 필요한 블록의 전체 크기 (정렬됨)
 
     // 1. 새로 필요한 전체 크기(newsize) 계산
-    if (size <= (2 * DSIZE)) {
-        newsize = MIN_BLOCK_SIZE;
-    } else {
-        newsize = ALIGN(size + DSIZE);
-    }
+    if ((newsize = adjust_size(size)) == 0) return NULL;
 
     // 2. 크기 변경 경우 처리
     // Case A: 새 크기가 원래 크기보다 작거나 같은 경우 (축소 또는 동일)
@@ -396,32 +2821,55 @@ void *mm_realloc(void *ptr, size_t size) {
     // Case B: 새 크기가 원래 크기보다 큰 경우 (확장)
     else {
         // B-1: 인접 블록(다음 블록) 병합으로 해결 가능한지 시도 (데이터 이동 없음)
-        void *new_ptr_inplace = mm_realloc_inplace(ptr, oldsize, newsize);
+        void *new_ptr_inplace = mm_realloc_inplace(h, ptr, oldsize, newsize);
         if (new_ptr_inplace != NULL) {
             return new_ptr_inplace; // 병합 성공 시 확장된 포인터 반환
         }
         // B-2: 인접 병합 실패 시, 새로 할당하고 데이터 복사
         else {
             // mm_realloc_copy가 malloc, memmove, free를 수행
-            return mm_realloc_copy(ptr, oldsize, size); // size는 사용자 요청 크기
+            return mm_realloc_copy(h, ptr, oldsize, size); // size는 사용자 요청 크기
         }
     }
 }
 
 // --- Realloc Helper: 인접 병합 시도 (다음 블록만 확인) ---
 // ptr: 현재 블록, oldsize: 현재 블록 크기, newsize: 필요한 새 크기
-static void *mm_realloc_inplace(void *ptr, size_t oldsize, size_t newsize) {
+static void *mm_realloc_inplace(mm_heap_t *h, void *ptr, size_t oldsize, size_t newsize) {
     void *next_bp = NEXT_BLKP(ptr); // 다음 블록
     size_t next_alloc = GET_ALLOC(HDRP(next_bp)); // 다음 블록 할당 상태
     size_t next_size = GET_SIZE(HDRP(next_bp)); // 다음 블록 크기
     size_t combined_size = oldsize + next_size; // 합쳤을 때 크기
 
+    // 힙의 마지막 블록이면 (다음이 에필로그이거나, 다음 가용 블록 뒤가 에필로그) 모자란 만큼만
+    // 힙을 늘려 제자리에서 키움. 오래 사는 블록이 힙 끝에 있을 때 복사 없이 자랄 수 있음.
+    // (nursery 청크의 에필로그 뒤는 부모 힙의 다른 블록이므로 최상위 힙에서만)
+    if (h->parent == NULL && combined_size < newsize
+        && (next_size == 0 || (!next_alloc && GET(HDRP(NEXT_BLKP(next_bp))) == PACK(0, 1)))) {
+        size_t avail = next_alloc ? oldsize : combined_size;
+        char *end = next_alloc ? (char *)next_bp : (char *)NEXT_BLKP(next_bp); // = 이 영역의 brk
+        // 블록이 있는 영역(또는 마지막 세그먼트)만 제자리에서 늘릴 수 있음
+        mem_region_t *r = (end == (char *)mem_region_hi(h->region) + 1) ? h->region : h->seg_last;
+        // 늘린 부분은 잠시 가용 블록이 되므로 최소 블록 크기 이상으로 늘림 (더 작으면 링크가 에필로그를 덮음)
+        if (r == NULL || end != (char *)mem_region_hi(r) + 1
+            || grow_region(h, r, MAX(newsize - avail, MIN_BLOCK_SIZE)) == NULL) {
+            return NULL;
+        }
+        next_bp = NEXT_BLKP(ptr); // 늘린 영역은 뒤쪽 가용 블록과 병합되어 있음
+        next_alloc = GET_ALLOC(HDRP(next_bp));
+        next_size = GET_SIZE(HDRP(next_bp));
+        combined_size = oldsize + next_size;
+    }
+
     // 다음 블록이 가용 상태이고, 합친 크기가 요구 크기(newsize) 이상이면 병합
-    if (!next_alloc && combined_size >= newsize) {
-        delete_node(next_bp); // 다음 블록을 가용 리스트에서 제거
+    if (!next_alloc && combined_size >= newsize && SIZE_FITS(combined_size)) {
+        delete_node(h, next_bp); // 다음 블록을 가용 리스트에서 제거
+        if (h->purge_stats.released != 0) { // 반납했던 페이지를 다시 씀
+            purge_touch(h, HDRP(next_bp), HDRP(next_bp) + next_size, 1);
+        }
         // 현재 블록(ptr)의 헤더/푸터를 합친 크기로 업데이트 (할당 상태 1 유지)
-        PUT(HDRP(ptr), PACK(combined_size, 1));
-        PUT(FTRP(ptr), PACK(combined_size, 1)); // FTRP(ptr) 사용!
+        PUT(HDRP(ptr), PACK(combined_size, 1 | ALLOC_TAG(h)));
+        PUT(FTRP(ptr), PACK(combined_size, 1 | ALLOC_TAG(h))); // FTRP(ptr) 사용!
 
         // TODO: 여기서도 병합 후 남는 공간 (combined_size - newsize)이 충분하면
         //       분할하여 가용화하는 최적화 가능 (place 함수 로직 참고).
@@ -437,9 +2885,9 @@ static void *mm_realloc_inplace(void *ptr, size_t oldsize, size_t newsize) {
 
 // --- Realloc Helper: 새로 할당 및 복사 ---
 // ptr: 원래 블록, oldsize: 원래 블록 전체 크기, size: 사용자 요청 새 데이터 크기
-static void *mm_realloc_copy(void *ptr, size_t oldsize, size_t size) {
+static void *mm_realloc_copy(mm_heap_t *h, void *ptr, size_t oldsize, size_t size) {
     // 1. 새 크기(size)만큼 새 블록 할당
-    void *newptr = mm_malloc(size);
+    void *newptr = mm_heap_malloc(h, size);
     if (newptr == NULL) return NULL; // 할당 실패
 
     // 2. 복사할 데이터 크기 계산
@@ -447,16 +2895,230 @@ static void *mm_realloc_copy(void *ptr, size_t oldsize, size_t size) {
     if (size < copySize) copySize = size; // 새 요청 크기가 더 작으면 그만큼만 복사
 
     // 3. 데이터 복사 (원래 블록 -> 새 블록)
-    //    memmove 사용 (memcpy도 가능하나, memmove가 겹치는 영역도 안전하게 처리)
-    memmove(newptr, ptr, copySize);
+    //    새 블록은 원래 블록과 겹치지 않으므로 크기별 복사 루틴 사용
+    block_copy(newptr, ptr, copySize);
 
     // 4. 원래 블록 해제
-    mm_free(ptr);
+    heap_free(h, ptr);
 
     // 5. 새로 할당된 블록 포인터 반환
     return newptr;
 }
 
+// ================= 버디 엔진 =================
+// 블록은 모두 2^k 바이트이고 힙 시작(base)에서의 오프셋이 2^k의 배수.
+// 짝(buddy)의 오프셋은 off ^ 2^k 이므로 주소 계산만으로 찾고, 차수별 비트맵에서
+// 그 짝이 같은 차수의 가용 블록인지 확인해 병합함. 분할/병합 모두 O(log n).
+// 힙은 필요한 차수의 블록을 정렬에 맞게 덧붙이며 자람 (정렬을 맞추려 먼저 붙인 작은 블록은 가용).
+
+// 버디 할당 블록: [헤더 BUDDY_HDR][페이로드]. 페이로드 바로 앞 워드는 분리 리스트 블록과 같은
+// 형식(크기 | 할당 비트)으로, 같은 페이로드를 담는 분리 리스트 블록 크기를 적음 (mm_inline.h와 호환)
+static void buddy_release(mm_heap_t *h, char *blk, int k);
+
+// 차수 k, 오프셋 off 블록의 비트맵 비트
+#define BUDDY_BIT(k, off) (h->buddy.map + h->buddy.map_off[k] + ((off) >> (k) >> 6))
+#define BUDDY_MASK(k, off) ((uint64_t)1 << (((off) >> (k)) & 63))
+
+// --- 버디 엔진 초기화 ---
+// 쓰던 비트맵 부분을 비우고, 영역의 남은 크기로 비트맵 크기를 정함 (처음 한 번, 또는 영역이 커졌을 때 새로 받음)
+static int buddy_init(mm_heap_t *h) {
+    size_t max = mem_region_room(h->region);
+    size_t words = 0;
+
+    if (h->buddy.map != NULL) {
+        for (int k = BUDDY_MIN_ORDER; k <= BUDDY_MAX_ORDER; k++) {
+            memset(h->buddy.map + h->buddy.map_off[k], 0, (((h->buddy.size >> k) + 63) / 64 + 1) * sizeof(uint64_t));
+        }
+    }
+    for (int k = BUDDY_MIN_ORDER; k <= BUDDY_MAX_ORDER; k++) {
+        h->buddy.map_off[k] = words;
+        words += ((max >> k) + 63) / 64 + 1;
+    }
+    if (words > h->buddy.map_words) {
+        if (h->buddy.map != NULL) {
+            munmap(h->buddy.map, h->buddy.map_words * sizeof(uint64_t));
+        }
+        h->buddy.map = mmap(NULL, words * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (h->buddy.map == MAP_FAILED) {
+            h->buddy.map = NULL;
+            h->buddy.map_words = 0;
+            return -1;
+        }
+        h->buddy.map_words = words;
+    }
+    h->buddy.base = (char *)mem_region_hi(h->region) + 1; // mem_reset_brk 뒤라면 mem_heap_lo()
+    h->buddy.size = 0;
+    h->buddy.avail = 0;
+    memset(h->buddy.free, 0, sizeof(h->buddy.free));
+    return 0;
+}
+
+// --- 가용 목록 넣기/빼기 ---
+static void buddy_push(mm_heap_t *h, char *blk, int k) {
+    size_t off = blk - h->buddy.base;
+
+    BUDDY_PREV(blk) = NULL;
+    BUDDY_NEXT(blk) = h->buddy.free[k];
+    if (h->buddy.free[k] != NULL) {
+        BUDDY_PREV(h->buddy.free[k]) = blk;
+    }
+    h->buddy.free[k] = blk;
+    h->buddy.avail |= (uint64_t)1 << k;
+    *BUDDY_BIT(k, off) |= BUDDY_MASK(k, off);
+}
+
+static void buddy_unlink(mm_heap_t *h, char *blk, int k) {
+    size_t off = blk - h->buddy.base;
+
+    if (BUDDY_PREV(blk) != NULL) {
+        BUDDY_NEXT(BUDDY_PREV(blk)) = BUDDY_NEXT(blk);
+    } else if ((h->buddy.free[k] = BUDDY_NEXT(blk)) == NULL) {
+        h->buddy.avail &= ~((uint64_t)1 << k);
+    }
+    if (BUDDY_NEXT(blk) != NULL) {
+        BUDDY_PREV(BUDDY_NEXT(blk)) = BUDDY_PREV(blk);
+    }
+    *BUDDY_BIT(k, off) &= ~BUDDY_MASK(k, off);
+}
+
+// 오프셋 off의 차수 k 블록이 통째로 가용인지
+static int buddy_is_free(mm_heap_t *h, size_t off, int k) {
+    return off + ((size_t)1 << k) <= h->buddy.size && (*BUDDY_BIT(k, off) & BUDDY_MASK(k, off));
+}
+
+// --- 힙 늘리기 ---
+// 차수 k 블록을 덧붙임. 끝 오프셋이 2^k의 배수가 아니면 끝의 정렬만큼 작은 블록을 먼저 붙임
+static int buddy_grow(mm_heap_t *h, int k) {
+    mem_region_t *r = h->region;
+
+    for (;;) {
+        int t = (h->buddy.size == 0) ? k : __builtin_ctzl(h->buddy.size);
+        if (t > k) {
+            t = k;
+        }
+        if (mem_region_room(r) < ((size_t)1 << t)) {
+            return -1;
+        }
+        char *blk = mem_region_sbrk(r, (intptr_t)1 << t);
+        h->buddy.size += (size_t)1 << t;
+        buddy_release(h, blk, t);
+        if (t == k) {
+            return 0;
+        }
+    }
+}
+
+// --- 블록 반납 (병합) ---
+// 짝이 같은 차수의 가용 블록인 동안 합치며 올라간 뒤 목록에 넣음
+static void buddy_release(mm_heap_t *h, char *blk, int k) {
+    size_t off = blk - h->buddy.base;
+
+    while (k < BUDDY_MAX_ORDER) {
+        size_t boff = off ^ ((size_t)1 << k);
+        if (!buddy_is_free(h, boff, k)) {
+            break;
+        }
+        buddy_unlink(h, h->buddy.base + boff, k);
+        off &= ~((size_t)1 << k);
+        k++;
+    }
+    buddy_push(h, h->buddy.base + off, k);
+}
+
+// 요청 크기 → 차수 (담을 수 없으면 -1)
+static int buddy_order(size_t size) {
+    size_t need = size + BUDDY_HDR;
+    int k;
+
+    if (size > ((size_t)1 << BUDDY_MAX_ORDER) - BUDDY_HDR) {
+        return -1;
+    }
+    k = (need <= 1) ? 0 : (int)(8 * sizeof(long)) - __builtin_clzl(need - 1);
+    return (k < BUDDY_MIN_ORDER) ? BUDDY_MIN_ORDER : k;
+}
+
+// 할당 블록 표시: 페이로드 앞 워드에 같은 페이로드의 분리 리스트 블록 크기를 적음
+static void *buddy_mark(char *blk, int k) {
+    PUT(blk + BUDDY_HDR - WSIZE, PACK(((size_t)1 << k) - BUDDY_HDR + DSIZE, 1));
+    return blk + BUDDY_HDR;
+}
+
+// 페이로드 → 차수
+static int buddy_block_order(void *ptr) {
+    return __builtin_ctzl(GET_SIZE(HDRP(ptr)) - DSIZE + BUDDY_HDR);
+}
+
+// --- 버디 할당 ---
+// k 이상에서 가장 작은 가용 차수를 골라 k가 될 때까지 반으로 나눔 (위쪽 반은 가용 목록으로)
+static void *buddy_malloc(mm_heap_t *h, size_t size) {
+    int k, j;
+    char *blk;
+
+    if (size == 0 || (k = buddy_order(size)) < 0) {
+        return NULL;
+    }
+    if ((h->buddy.avail >> k) == 0 && buddy_grow(h, k) < 0) {
+        return NULL;
+    }
+    j = k + __builtin_ctzll(h->buddy.avail >> k);
+    blk = h->buddy.free[j];
+    buddy_unlink(h, blk, j);
+    while (j > k) {
+        j--;
+        buddy_push(h, blk + ((size_t)1 << j), j);
+    }
+    return buddy_mark(blk, k);
+}
+
+// --- 버디 해제 ---
+static void buddy_free(mm_heap_t *h, void *ptr) {
+    if (ptr == NULL) return;
+    buddy_release(h, (char *)ptr - BUDDY_HDR, buddy_block_order(ptr));
+}
+
+// --- 버디 재할당 ---
+// 줄이면 위쪽 반들을 떼어 내고, 늘리면 위쪽 짝들이 모두 가용일 때 제자리에서 합침. 안 되면 복사
+static void *buddy_realloc(mm_heap_t *h, void *ptr, size_t size) {
+    char *blk;
+    size_t off;
+    int k, need, j;
+    void *newptr;
+
+    if (ptr == NULL) return buddy_malloc(h, size);
+    if (size == 0) { buddy_free(h, ptr); return NULL; }
+    if ((need = buddy_order(size)) < 0) return NULL;
+
+    blk = (char *)ptr - BUDDY_HDR;
+    off = blk - h->buddy.base;
+    k = buddy_block_order(ptr);
+    if (need <= k) {
+        while (k > need) {
+            k--;
+            buddy_release(h, blk + ((size_t)1 << k), k);
+        }
+        return buddy_mark(blk, k);
+    }
+
+    // blk가 차수 j+1 블록의 아래쪽 반이고 위쪽 짝이 가용인 동안 올라감
+    for (j = k; j < need; j++) {
+        if ((off & ((size_t)1 << j)) || !buddy_is_free(h, off + ((size_t)1 << j), j)) {
+            break;
+        }
+    }
+    if (j == need) {
+        for (j = k; j < need; j++) {
+            buddy_unlink(h, blk + ((size_t)1 << j), j);
+        }
+        return buddy_mark(blk, need);
+    }
+
+    if ((newptr = buddy_malloc(h, size)) == NULL) return NULL;
+    block_copy(newptr, ptr, ((size_t)1 << k) - BUDDY_HDR);
+    buddy_free(h, ptr);
+    return newptr;
+}
+
 /*
  * mm-naive.c - The fastest, least memory-efficient malloc package.
  *
@@ -1,3 +1,6 @@
+#ifndef __MM_H_
+#define __MM_H_
+
 #include <stdio.h>
 
 extern int mm_init (void);
@@ -5,6 +8,230 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 
+/*
+ * mm_memalign returns a block whose payload starts on an align-byte
+ * boundary (align a power of two); mm_usable_size is how many payload
+ * bytes a block holds, at least the size it was requested with. The
+ * buddy engine serves alignments up to ALIGNMENT only.
+ */
+extern void *mm_memalign(size_t align, size_t size);
+extern size_t mm_usable_size(void *ptr);
+
+/*
+ * Engines. The binary buddy engine trades density for O(log n) split
+ * and merge with power-of-two blocks. Each heap keeps the engine that
+ * was set when it was made: the default heap at mm_init, others at
+ * mm_heap_create; shared and file heaps always use the segregated
+ * lists. A buddy heap locks and resets like any other, but ignores
+ * lifetime hints, hands out no handles (halloc returns 0 and compact
+ * trims nothing) and cannot run the background worker, so mm_init
+ * fails (EINVAL) to switch the default heap to it while the worker
+ * runs. MM_ENGINE picks the default at build time.
+ */
+#define MM_ENGINE_SEGLIST 0
+#define MM_ENGINE_BUDDY   1
+
+extern int mm_set_engine(int engine);
+
+/*
+ * Blocks that realloc moves are copied with streaming (non-temporal)
+ * stores from this many bytes on, so the copy does not evict the
+ * cache; 0 turns streaming off. Returns the previous threshold.
+ */
+extern size_t mm_set_copy_threshold(size_t bytes);
+
+/*
+ * Runtime configuration. mm_get_config returns the settings in force:
+ * the built-in defaults, then the MM_CONF environment variable, then
+ * later calls such as mm_set_engine. mm_init_ex makes conf current and
+ * initializes the default heap (NULL keeps the current settings);
+ * mm_init reuses the current settings. A heap takes chunk_size,
+ * classes, split_min, tail_min, line_place and hot_bins when it is
+ * created; reserve applies to the default heap. Zero chunk_size,
+ * classes or split_min mean the default.
+ *
+ * MM_CONF is a list of key=value entries separated by commas or
+ * spaces, with the keys named below; sizes take a K/M/G suffix:
+ *     MM_CONF="chunk=64K,classes=12,reserve=1M,engine=buddy,line=0"
+ * mm_config_parse applies such a string to conf and returns -1 if an
+ * entry is malformed (the others are still applied).
+ */
+typedef struct mm_config {
+    size_t chunk_size;     /* chunk: heap growth step in bytes */
+    unsigned int classes;  /* classes: size classes in use (at most the built table's) */
+    size_t split_min;      /* split: smallest remainder split off a free block */
+    size_t tail_min;       /* tail: blocks this big go at the end of a free block (0 = off, else at least 72) */
+    size_t reserve;        /* reserve: free space the default heap starts with */
+    size_t max_heap;       /* max_heap: heap limit drivers give memlib (0 = MAX_HEAP) */
+    int engine;            /* engine: seglist or buddy */
+    int line_place;        /* line: keep small payloads within one cache line */
+    int hot_bins;          /* hot: exact-fit bins for frequent sizes */
+    long decay_ms;         /* decay: as for mm_set_decay */
+    size_t copy_threshold; /* copy: as for mm_set_copy_threshold */
+} mm_config_t;
+
+extern void mm_get_config(mm_config_t *conf);
+extern int mm_config_parse(mm_config_t *conf, const char *str);
+extern int mm_init_ex(const mm_config_t *conf);
+
+/*
+ * Independent heaps. Each heap owns its own free lists and its own
+ * memlib region; the functions above operate on a default heap.
+ */
+typedef struct mm_heap mm_heap_t;
+
+extern mm_heap_t *mm_heap_create(size_t max_size);
+extern void mm_heap_destroy(mm_heap_t *heap);
+extern int mm_heap_reset(mm_heap_t *heap);
+extern void *mm_heap_malloc(mm_heap_t *heap, size_t size);
+extern void mm_heap_free(mm_heap_t *heap, void *ptr);
+extern void *mm_heap_realloc(mm_heap_t *heap, void *ptr, size_t size);
+extern void *mm_heap_memalign(mm_heap_t *heap, size_t align, size_t size);
+
+/*
+ * mm_heap_reset empties a heap made by mm_heap_create, as mm_init does
+ * for the default heap: every block goes away at once, and the memory
+ * stays mapped for the next use. It fails (EINVAL) on shared and file
+ * heaps and while the heap's worker runs.
+ */
+
+/*
+ * mm_heap_contains is true if the size bytes at ptr lie inside the
+ * memory of heap (mm_contains: the default heap). It reads the heap
+ * bounds under the heap lock, so a checker may call it while other
+ * threads grow or shrink a locked heap.
+ */
+extern int mm_contains(const void *ptr, size_t size);
+extern int mm_heap_contains(mm_heap_t *heap, const void *ptr, size_t size);
+
+/*
+ * File-backed heaps. mm_heap_open maps a heap file, creating an empty
+ * heap if the file is new; an existing heap can be used right away.
+ * The free-block index and handle table are kept in the file, at the
+ * top of max_size. A heap closed with mm_heap_close and mapped at the
+ * same address again resumes without walking its blocks: only its two
+ * ends are checked. Otherwise (another address, or a process that
+ * ended without mm_heap_close) every block is walked, checked and
+ * re-indexed. Blocks keep their contents, and the root pointer is
+ * stored as an offset so it survives a different mapping address.
+ */
+extern mm_heap_t *mm_heap_open(const char *path, size_t max_size);
+extern int mm_heap_sync(mm_heap_t *heap);
+extern int mm_heap_close(mm_heap_t *heap);
+extern void mm_heap_set_root(mm_heap_t *heap, void *ptr);
+extern void *mm_heap_root(mm_heap_t *heap);
+
+/*
+ * Shared heaps. Every process maps the heap at the same address, so a
+ * block allocated in one process can be handed to another and freed
+ * there. name == NULL makes an anonymous heap shared with children
+ * forked afterwards; a name makes a POSIX shared memory object that
+ * other processes attach to. Calls on a shared heap take a
+ * process-shared lock; mm_heap_destroy only detaches the caller.
+ *
+ * If a process dies holding the lock, the next caller walks every
+ * block and rebuilds the free index and handle table before going on,
+ * as mm_heap_open does after an unclean exit. If the blocks themselves
+ * were left torn, the heap is given up: from then on, every call on it
+ * fails (NULL, 0 or -1, errno EINVAL).
+ *
+ * Blocks and free-list links are plain pointers, not offsets, so
+ * mm_heap_attach can only map the heap at its creator's address. If
+ * any of that range is already in use in the attaching process (other
+ * mappings, ASLR, a different binary) it returns NULL with errno set
+ * to EADDRINUSE. Attach early, before the process maps much, or share
+ * the heap with forked children (name == NULL), which inherit the
+ * mapping.
+ */
+extern mm_heap_t *mm_heap_create_shared(const char *name, size_t max_size);
+extern mm_heap_t *mm_heap_attach(const char *name);
+extern int mm_heap_unlink(const char *name);
+
+/*
+ * Page purging. The whole pages inside a large free block are given
+ * back to the OS (madvise) once the block has stayed free for the
+ * decay period; its boundary tags stay in place. A negative period
+ * turns automatic purging off; mm_purge(1) purges everything now.
+ * Purging only applies to private anonymous heaps.
+ */
+typedef struct {
+    size_t purged;   /* pages given back so far */
+    size_t refaults; /* purged pages that were allocated again */
+    size_t released; /* pages given back and not reused yet */
+} mm_purge_stats_t;
+
+extern void mm_set_decay(long ms);
+extern size_t mm_purge(int all);
+extern void mm_purge_stats(mm_purge_stats_t *stats);
+extern void mm_heap_set_decay(mm_heap_t *heap, long ms);
+extern size_t mm_heap_purge(mm_heap_t *heap, int all);
+extern void mm_heap_purge_stats(mm_heap_t *heap, mm_purge_stats_t *stats);
+
+/*
+ * Locking. A heap is used from one thread unless locking is turned on:
+ * then every call takes the heap's lock, so any number of threads may
+ * share the heap. mm_set_locking and mm_heap_set_locking return the
+ * previous setting; no other thread may be using the heap while it is
+ * changed. Shared heaps are always locked.
+ */
+extern int mm_set_locking(int on);
+extern int mm_heap_set_locking(mm_heap_t *heap, int on);
+
+/*
+ * Background worker. While it runs, frees only queue the block and
+ * return; the worker wakes every wake_ms milliseconds (or after
+ * wake_batch queued frees) to coalesce the queued blocks, purge decayed
+ * pages and reselect the hot bins. A free that finds the queue full is
+ * done inline. The worker and the caller's thread need the heap lock,
+ * so it is taken while the worker runs whether or not locking is on.
+ * Stopping the worker applies the queued frees. If locking is off, the
+ * heap goes back to being unlocked: other threads must have stopped
+ * using it before mm_stop_worker/mm_heap_stop_worker is called. With
+ * locking on, they may keep going. Zero fields take the defaults.
+ * Not available for shared heaps and buddy heaps (EINVAL).
+ */
+typedef struct {
+    unsigned int wake_ms; /* wake-up period */
+    size_t queue_cap;     /* deferred frees held at most (rounded up to 2^n) */
+    size_t wake_batch;    /* wake early after this many queued frees */
+} mm_worker_config_t;
+
+extern int mm_start_worker(const mm_worker_config_t *config);
+extern void mm_stop_worker(void);
+extern int mm_heap_start_worker(mm_heap_t *heap, const mm_worker_config_t *config);
+extern void mm_heap_stop_worker(mm_heap_t *heap);
+
+/*
+ * Lifetime hints. Short-lived blocks are carved from separate chunks so
+ * that they do not leave holes between long-lived ones; free and
+ * realloc need no hint.
+ */
+#define MM_SHORT_LIVED 0x1
+#define MM_LONG_LIVED  0x2
+
+extern void *mm_malloc_hint(size_t size, int hint);
+extern void *mm_heap_malloc_hint(mm_heap_t *heap, size_t size, int hint);
+
+/*
+ * Relocatable allocations. A handle names a block that mm_compact may
+ * move while it is unlocked; mm_hlock pins it and returns its current
+ * address. Compaction slides unlocked handle blocks down over free
+ * space and returns the number of bytes trimmed from the heap end.
+ * A handle of 0 is never valid.
+ */
+typedef size_t mm_handle_t;
+
+extern mm_handle_t mm_halloc(size_t size);
+extern void mm_hfree(mm_handle_t handle);
+extern void *mm_hlock(mm_handle_t handle);
+extern void mm_hunlock(mm_handle_t handle);
+extern size_t mm_compact(void);
+extern mm_handle_t mm_heap_halloc(mm_heap_t *heap, size_t size);
+extern void mm_heap_hfree(mm_heap_t *heap, mm_handle_t handle);
+extern void *mm_heap_hlock(mm_heap_t *heap, mm_handle_t handle);
+extern void mm_heap_hunlock(mm_heap_t *heap, mm_handle_t handle);
+extern size_t mm_heap_compact(mm_heap_t *heap);
+
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, 
@@ -21,3 +248,4 @@ typedef struct {
 
 extern team_t team;
 
+#endif /* __MM_H_ */
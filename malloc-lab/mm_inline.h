@@ -0,0 +1,81 @@
+/*
+ * mm_inline.h - inlinable fast path for small blocks of the default heap
+ *
+ * Each thread keeps a few freed small blocks per size class in a quick
+ * list. mm_malloc_inline pops one and mm_free_inline pushes one without
+ * leaving the caller; everything else goes to mm_malloc/mm_free. Blocks
+ * in a quick list stay allocated as far as the heap is concerned.
+ *
+ * With a compile-time constant size the class test and index fold to
+ * constants, leaving one load, one test and one store on the hit path.
+ *
+ * Blocks from mm_malloc and mm_malloc_inline may be freed with either
+ * mm_free or mm_free_inline. A thread should call mm_quick_flush before
+ * it exits, and every thread must flush before another calls mm_init
+ * (mm_init only drops the calling thread's lists).
+ */
+#ifndef __MM_INLINE_H_
+#define __MM_INLINE_H_
+
+#include <stddef.h>
+#include "mm.h"
+
+#define MM_QUICK_UNIT 16     /* class granularity in payload bytes */
+#define MM_QUICK_CLASSES 16  /* classes 1..16 cover payloads up to 256 bytes */
+#define MM_QUICK_MAX (MM_QUICK_UNIT * MM_QUICK_CLASSES)
+#define MM_QUICK_DEPTH 32    /* blocks kept per class */
+
+/* Smallest class whose blocks hold size payload bytes (0 < size <= MAX) */
+#define MM_QUICK_CLASS(size) (((size) + MM_QUICK_UNIT - 1) / MM_QUICK_UNIT)
+
+/*
+ * Block layout shared with mm.c: a 4-byte header right before the
+ * payload, size in the upper bits, bit 1 set for encoded huge sizes,
+ * and 8 bytes of header plus footer per block.
+ */
+#define MM_QUICK_HDR(p) (*(const unsigned int *)((const char *)(p) - 4))
+#define MM_QUICK_HUGE 0x2u
+#define MM_QUICK_OVERHEAD 8u
+
+typedef struct {
+    void *head[MM_QUICK_CLASSES + 1];          /* next word of a block links the list */
+    unsigned int count[MM_QUICK_CLASSES + 1];
+} mm_quick_t;
+
+extern __thread mm_quick_t mm_quick;
+extern void mm_quick_flush(void);
+
+static inline __attribute__((always_inline)) void *mm_malloc_inline(size_t size)
+{
+    if (size - 1 < MM_QUICK_MAX) {              /* 0 < size <= MAX */
+        size_t c = MM_QUICK_CLASS(size);
+        void *p = mm_quick.head[c];
+
+        if (__builtin_expect(p != NULL, 1)) {
+            mm_quick.head[c] = *(void **)p;
+            mm_quick.count[c]--;
+            return p;
+        }
+    }
+    return mm_malloc(size);
+}
+
+static inline __attribute__((always_inline)) void mm_free_inline(void *ptr)
+{
+    if (ptr != NULL) {
+        unsigned int hdr = MM_QUICK_HDR(ptr);
+        /* the class every request it can hold rounds up to */
+        size_t c = ((hdr & ~7u) - MM_QUICK_OVERHEAD) / MM_QUICK_UNIT;
+
+        if (!(hdr & MM_QUICK_HUGE) && c <= MM_QUICK_CLASSES &&
+            mm_quick.count[c] < MM_QUICK_DEPTH) {
+            *(void **)ptr = mm_quick.head[c];
+            mm_quick.head[c] = ptr;
+            mm_quick.count[c]++;
+            return;
+        }
+    }
+    mm_free(ptr);
+}
+
+#endif /* __MM_INLINE_H_ */
@@ -0,0 +1,351 @@
+/*
+ * mmpreload.c - mm.c as the process allocator (libmm.so)
+ *
+ * Linked into libmm.so with mm.c and memlib.c, this file defines
+ * malloc, free, realloc, calloc, memalign and the other libc entry
+ * points on top of the mm default heap, so that unmodified programs
+ * can be run on it:
+ *
+ *     LD_PRELOAD=./libmm.so program ...
+ *
+ * The memlib default region is reserved (not committed) by the first
+ * call; once it is full, mm.c goes on in separate segments, which this
+ * library alone lets grow past the reservation (mem_region_set_spill:
+ * elsewhere segments count against the heap limit). A single
+ * lock serializes all calls and is held across fork, so the child
+ * starts from a consistent heap. MM_CONF configures the allocator as
+ * for any other mm client (max_heap sizes the reservation). Statistics
+ * are written to stderr at exit unless MM_STATS=0.
+ *
+ * Pointers that did not come from this heap (allocated by the dynamic
+ * loader before the library was in place) are ignored by free.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <malloc.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/* address space reserved at start: 64 GB, or 1 GB with 32-bit pointers */
+#define PRELOAD_HEAP ((size_t)1 << (sizeof(void *) > 4 ? 36 : 30))
+#define BOOT_SIZE (16 * 1024)          /* served to calls made while the heap is set up */
+#define BOOT_HDR 16                    /* size word in front of each boot block */
+
+/* Heap state: not set up, being set up, ready, or setup failed */
+enum { HEAP_NONE, HEAP_SETUP, HEAP_READY, HEAP_FAILED };
+
+static pthread_mutex_t lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static int state = HEAP_NONE;
+
+/* Bump area for allocations made by the setup itself; never freed */
+static char boot[BOOT_SIZE] __attribute__((aligned(16)));
+static size_t boot_used;
+
+/* Counters printed at exit */
+static struct {
+    size_t mallocs, frees, reallocs, callocs, memaligns;
+    size_t failed;   /* requests that returned NULL */
+    size_t foreign;  /* frees of pointers from outside the heap */
+    size_t live;     /* usable bytes of allocated blocks */
+    size_t peak;     /* largest value of live */
+} stats;
+static int stats_fd = STDERR_FILENO; /* copy of stderr taken at load time */
+
+/*
+ * heap_setup - reserve the memlib region and initialize mm on the
+ *     first call. Called with the lock held; returns -1 while the setup
+ *     is running (a recursive call) or if it failed.
+ */
+static int heap_setup(void)
+{
+    mm_config_t conf;
+
+    if (state == HEAP_READY)
+        return 0;
+    if (state != HEAP_NONE)
+        return -1;
+    state = HEAP_SETUP;
+    mm_get_config(&conf);
+    mem_init_size(conf.max_heap != 0 ? conf.max_heap : PRELOAD_HEAP);
+    mem_region_set_spill(mem_default_region(), 1);
+    state = (mm_init() < 0) ? HEAP_FAILED : HEAP_READY;
+    return (state == HEAP_READY) ? 0 : -1;
+}
+
+static void *boot_alloc(size_t size)
+{
+    char *p;
+    size_t need = BOOT_HDR + ((size + 15) & ~(size_t)15);
+
+    if (size > BOOT_SIZE || need > BOOT_SIZE - boot_used)
+        return NULL;
+    p = boot + boot_used;
+    boot_used += need;
+    *(size_t *)p = size;
+    return p + BOOT_HDR;
+}
+
+static int is_boot(const void *p)
+{
+    return (const char *)p >= boot && (const char *)p < boot + BOOT_SIZE;
+}
+
+/* True if p is a block of the mm heap */
+static int is_ours(void *p)
+{
+    return state == HEAP_READY && mem_heap_contains(p, p);
+}
+
+static void count_alloc(void *p)
+{
+    if (p == NULL) {
+        stats.failed++;
+        return;
+    }
+    stats.live += mm_usable_size(p);
+    if (stats.live > stats.peak)
+        stats.peak = stats.live;
+}
+
+/* alloc_locked - allocate size bytes aligned to align (lock held) */
+static void *alloc_locked(size_t align, size_t size)
+{
+    void *p;
+
+    if (size == 0)
+        size = 1; /* like glibc, malloc(0) returns a unique pointer */
+    if (heap_setup() < 0)
+        return (align <= 16) ? boot_alloc(size) : NULL;
+    p = (align <= 16) ? mm_malloc(size) : mm_memalign(align, size);
+    count_alloc(p);
+    return p;
+}
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    pthread_mutex_lock(&lock);
+    stats.mallocs++;
+    p = alloc_locked(0, size);
+    pthread_mutex_unlock(&lock);
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL || is_boot(ptr))
+        return;
+    pthread_mutex_lock(&lock);
+    stats.frees++;
+    if (is_ours(ptr)) {
+        stats.live -= mm_usable_size(ptr);
+        mm_free(ptr);
+    } else {
+        stats.foreign++;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p = NULL;
+    size_t old;
+
+    if (ptr == NULL)
+        return malloc(size);
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    pthread_mutex_lock(&lock);
+    stats.reallocs++;
+    if (is_ours(ptr)) {
+        old = mm_usable_size(ptr);
+        if ((p = mm_realloc(ptr, size)) != NULL) {
+            stats.live -= old;
+            count_alloc(p);
+        } else {
+            stats.failed++;
+        }
+    } else if (is_boot(ptr)) {
+        /* boot blocks move to the heap and stay behind */
+        old = *(size_t *)((char *)ptr - BOOT_HDR);
+        if ((p = alloc_locked(0, size)) != NULL)
+            memcpy(p, ptr, old < size ? old : size);
+    } else {
+        stats.foreign++; /* size unknown: cannot move it */
+    }
+    pthread_mutex_unlock(&lock);
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+    size_t bytes;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_lock(&lock);
+    stats.callocs++;
+    p = alloc_locked(0, bytes);
+    pthread_mutex_unlock(&lock);
+    if (p == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (!is_boot(p)) /* the boot area is never reused, so still zero */
+        memset(p, 0, bytes);
+    return p;
+}
+
+void *memalign(size_t align, size_t size)
+{
+    void *p;
+
+    /* like glibc, round an alignment that is not a power of two up */
+    if (align & (align - 1))
+        align = (size_t)1 << (64 - __builtin_clzl(align));
+    pthread_mutex_lock(&lock);
+    stats.memaligns++;
+    p = alloc_locked(align, size);
+    pthread_mutex_unlock(&lock);
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (align == 0 || (align & (align - 1)) || align % sizeof(void *))
+        return EINVAL;
+    pthread_mutex_lock(&lock);
+    stats.memaligns++;
+    p = alloc_locked(align, size);
+    pthread_mutex_unlock(&lock);
+    if (p == NULL)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+void *valloc(size_t size)
+{
+    return memalign(mem_pagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t page = mem_pagesize();
+
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    size_t size = 0;
+
+    if (ptr == NULL)
+        return 0;
+    if (is_boot(ptr))
+        return *(size_t *)((char *)ptr - BOOT_HDR);
+    pthread_mutex_lock(&lock);
+    if (is_ours(ptr))
+        size = mm_usable_size(ptr);
+    pthread_mutex_unlock(&lock);
+    return size;
+}
+
+/*
+ * Fork: hold the lock across fork so that no other thread is in the
+ * middle of an operation. The child's copy of the lock belongs to a
+ * thread id that no longer exists there, so it gets a fresh one.
+ */
+static void fork_prepare(void)
+{
+    pthread_mutex_lock(&lock);
+}
+
+static void fork_parent(void)
+{
+    pthread_mutex_unlock(&lock);
+}
+
+static void fork_child(void)
+{
+    pthread_mutex_t fresh = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+    lock = fresh;
+}
+
+/*
+ * preload_start - register the fork handlers and keep a copy of stderr
+ *     for the statistics (programs such as coreutils close stderr
+ *     before exit).
+ */
+static void __attribute__((constructor)) preload_start(void)
+{
+    int fd;
+
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+    if ((fd = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3)) >= 0)
+        stats_fd = fd;
+}
+
+/*
+ * preload_stats - write the counters and heap sizes to stderr at exit.
+ *     Uses write(2) only: stdio may already be shut down.
+ */
+static void __attribute__((destructor)) preload_stats(void)
+{
+    const char *env = getenv("MM_STATS");
+    mm_purge_stats_t purge;
+    char buf[512];
+    size_t heap, peak;
+    int n;
+
+    if (env != NULL && strcmp(env, "0") == 0)
+        return;
+    pthread_mutex_lock(&lock);
+    if (state != HEAP_READY) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    heap = mem_region_footprint(mem_default_region());
+    peak = mem_heap_peak();
+    mm_purge_stats(&purge);
+    n = snprintf(buf, sizeof(buf),
+                 "libmm[%d]: %zu malloc, %zu free, %zu realloc, %zu calloc, "
+                 "%zu memalign (%zu failed, %zu foreign frees)\n"
+                 "libmm[%d]: heap %zu KB now, %zu KB peak; %zu KB in use, "
+                 "%zu KB peak (%.1f%% of peak heap); %zu pages purged\n",
+                 (int)getpid(), stats.mallocs, stats.frees, stats.reallocs,
+                 stats.callocs, stats.memaligns, stats.failed, stats.foreign,
+                 (int)getpid(), heap >> 10, peak >> 10, stats.live >> 10,
+                 stats.peak >> 10, peak ? 100.0 * stats.peak / peak : 0.0,
+                 purge.purged);
+    pthread_mutex_unlock(&lock);
+    if (n > 0)
+        write(stats_fd, buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+}
@@ -0,0 +1,213 @@
+/*
+ * rep2bin.c - Convert .rep trace files to the binary format of tracebin.h
+ *
+ * mdriver parses a .rep file one token at a time with fscanf before it
+ * can replay it, which for large captured traces takes longer than the
+ * replay itself. A binary trace is mapped and replayed in place, so
+ * convert big traces once and pass the .bin file to mdriver -f.
+ *
+ * Each request is checked while converting (type, id in range, request
+ * count matching the header), and the header records a checksum of the
+ * requests that mdriver verifies when it maps the file.
+ *
+ *   usage: rep2bin [-o outfile] tracefile...
+ *
+ * Without -o, foo.rep is written to foo.bin next to it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "mm.h"
+#include "tracebin.h"
+
+#define MAXLINE 1024
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: rep2bin [-o outfile] tracefile...\n");
+	exit(1);
+}
+
+/* Report a problem at line lineno of file path and give up */
+static void bad_line(const char *path, long lineno, const char *what)
+{
+	fprintf(stderr, "rep2bin: %s:%ld: %s\n", path, lineno, what);
+	exit(1);
+}
+
+/*
+ * next_line - Read the next non-blank line of f into buf. Returns 0 at
+ *     end of file.
+ */
+static int next_line(FILE *f, char *buf, long *lineno)
+{
+	while (fgets(buf, MAXLINE, f) != NULL)
+	{
+		(*lineno)++;
+		if (buf[strspn(buf, " \t\r\n")] != '\0')
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * read_rep - Read the text trace at path into hdr and a malloc'd array
+ *     of records, checking every request.
+ */
+static traceop_t *read_rep(const char *path, trace_hdr_t *hdr)
+{
+	char buf[MAXLINE];
+	unsigned long long heap, size;
+	unsigned long ids, nops, weight, index;
+	traceop_t *ops;
+	unsigned long n = 0;
+	long lineno = 0;
+	char type;
+	int got;
+	FILE *f;
+
+	if ((f = fopen(path, "r")) == NULL)
+	{
+		fprintf(stderr, "rep2bin: %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	if (!next_line(f, buf, &lineno) || sscanf(buf, "%llu", &heap) != 1 ||
+		!next_line(f, buf, &lineno) || sscanf(buf, "%lu", &ids) != 1 ||
+		!next_line(f, buf, &lineno) || sscanf(buf, "%lu", &nops) != 1 ||
+		!next_line(f, buf, &lineno) || sscanf(buf, "%lu", &weight) != 1)
+		bad_line(path, lineno, "bad header");
+	if (ids == 0 || ids > 0x7fffffffUL || nops > 0x7fffffffUL)
+		bad_line(path, lineno, "id or request count out of range");
+
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, TRACE_MAGIC, sizeof(hdr->magic));
+	hdr->version = TRACE_VERSION;
+	hdr->byte_order = TRACE_BYTE_ORDER;
+	hdr->sugg_heapsize = heap;
+	hdr->num_ids = ids;
+	hdr->num_ops = nops;
+	hdr->weight = weight;
+	hdr->op_size = sizeof(traceop_t);
+
+	/* calloc leaves the pad bytes, which the checksum covers, zero */
+	if ((ops = calloc(nops ? nops : 1, sizeof(traceop_t))) == NULL)
+	{
+		fprintf(stderr, "rep2bin: out of memory\n");
+		exit(1);
+	}
+	while (next_line(f, buf, &lineno))
+	{
+		if (n == nops)
+			bad_line(path, lineno, "more requests than the header says");
+		size = 0;
+		if ((got = sscanf(buf, " %c %lu %llu", &type, &index, &size)) < 2 ||
+			(got < 3 && type != 'f'))
+			bad_line(path, lineno, "bad request");
+		switch (type)
+		{
+		case 'a':
+		case 's': /* alloc with MM_SHORT_LIVED hint */
+		case 'l': /* alloc with MM_LONG_LIVED hint */
+			ops[n].type = ALLOC;
+			ops[n].hint = (type == 's')	  ? MM_SHORT_LIVED
+						  : (type == 'l') ? MM_LONG_LIVED
+										  : 0;
+			break;
+		case 'r':
+			ops[n].type = REALLOC;
+			break;
+		case 'f':
+			ops[n].type = FREE;
+			size = 0;
+			break;
+		default:
+			bad_line(path, lineno, "bogus request type");
+		}
+		if (index >= ids)
+			bad_line(path, lineno, "id out of range");
+		ops[n].index = index;
+		ops[n].size = size;
+		n++;
+	}
+	if (n != nops)
+		bad_line(path, lineno, "fewer requests than the header says");
+	fclose(f);
+
+	hdr->checksum = trace_checksum(ops, nops);
+	return ops;
+}
+
+/* Write the header and records to path */
+static void write_bin(const char *path, const trace_hdr_t *hdr,
+					  const traceop_t *ops)
+{
+	FILE *f;
+
+	if ((f = fopen(path, "wb")) == NULL ||
+		fwrite(hdr, sizeof(*hdr), 1, f) != 1 ||
+		fwrite(ops, sizeof(traceop_t), hdr->num_ops, f) != hdr->num_ops ||
+		fclose(f) != 0)
+	{
+		fprintf(stderr, "rep2bin: %s: %s\n", path, strerror(errno));
+		unlink(path);
+		exit(1);
+	}
+}
+
+/* Output name for path: foo.rep becomes foo.bin, anything else gets .bin */
+static char *bin_name(const char *path)
+{
+	size_t len = strlen(path);
+	char *out = malloc(len + 5);
+
+	if (out == NULL)
+	{
+		fprintf(stderr, "rep2bin: out of memory\n");
+		exit(1);
+	}
+	strcpy(out, path);
+	if (len > 4 && strcmp(path + len - 4, ".rep") == 0)
+		strcpy(out + len - 4, ".bin");
+	else
+		strcat(out, ".bin");
+	return out;
+}
+
+int main(int argc, char **argv)
+{
+	trace_hdr_t hdr;
+	traceop_t *ops;
+	char *outfile = NULL;
+	char *out;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "o:h")) != EOF)
+	{
+		switch (c)
+		{
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind == argc || (outfile != NULL && argc - optind > 1))
+		usage();
+
+	for (i = optind; i < argc; i++)
+	{
+		ops = read_rep(argv[i], &hdr);
+		out = (outfile != NULL) ? outfile : bin_name(argv[i]);
+		write_bin(out, &hdr, ops);
+		printf("%s: %u requests, %u ids -> %s\n",
+			   argv[i], hdr.num_ops, hdr.num_ids, out);
+		if (out != outfile)
+			free(out);
+		free(ops);
+	}
+	return 0;
+}
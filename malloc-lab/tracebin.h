@@ -0,0 +1,79 @@
+/*
+ * tracebin.h - Binary trace format shared by mdriver and rep2bin
+ *
+ * A binary trace holds the same requests as a .rep file, laid out so
+ * that mdriver can map the file and replay the records where they lie,
+ * without parsing or copying them:
+ *
+ *     trace_hdr_t          header (48 bytes)
+ *     traceop_t[num_ops]   one 16-byte record per request
+ *
+ * Fields are fixed-width and the same for 32- and 64-bit builds. They
+ * are stored in the byte order of the machine that wrote the file; a
+ * file from a machine with the other byte order is rejected, so rerun
+ * rep2bin there. The checksum covers the op records, pad bytes
+ * included (rep2bin writes them as zero).
+ */
+#ifndef __TRACEBIN_H_
+#define __TRACEBIN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRACE_MAGIC "mmtrace"		 /* 8 bytes with the NUL */
+#define TRACE_VERSION 1
+#define TRACE_BYTE_ORDER 0x01020304u /* reads back swapped on the other order */
+
+/* Request types */
+enum
+{
+	ALLOC,
+	FREE,
+	REALLOC
+};
+
+/* One trace operation (allocator request) */
+typedef struct
+{
+	uint8_t type;	/* ALLOC, FREE or REALLOC */
+	uint8_t hint;	/* lifetime hint for mm_malloc_hint (0 = none) */
+	uint16_t pad;	/* zero */
+	uint32_t index; /* id that the request allocates, resizes or frees */
+	uint64_t size;	/* byte size of alloc/realloc request (0 for free) */
+} traceop_t;
+
+/* File header, followed by num_ops records */
+typedef struct
+{
+	char magic[8];			/* TRACE_MAGIC */
+	uint32_t version;		/* TRACE_VERSION */
+	uint32_t byte_order;	/* TRACE_BYTE_ORDER as written */
+	uint64_t sugg_heapsize; /* suggested heap size */
+	uint32_t num_ids;		/* number of alloc/realloc ids */
+	uint32_t num_ops;		/* number of requests */
+	uint32_t weight;		/* weight of the trace (unused) */
+	uint32_t op_size;		/* sizeof(traceop_t) */
+	uint64_t checksum;		/* trace_checksum of the records */
+} trace_hdr_t;
+
+_Static_assert(sizeof(traceop_t) == 16, "traceop_t must be 16 bytes");
+_Static_assert(sizeof(trace_hdr_t) == 48, "trace_hdr_t must be 48 bytes");
+
+/*
+ * trace_checksum - FNV-1a over the records, taken a 64-bit word at a
+ *     time instead of a byte at a time so that checking a mapped trace
+ *     costs little next to replaying it.
+ */
+static inline uint64_t trace_checksum(const traceop_t *ops, size_t num_ops)
+{
+	const uint64_t *w = (const uint64_t *)ops;
+	size_t n = num_ops * (sizeof(traceop_t) / sizeof(uint64_t));
+	uint64_t h = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		h = (h ^ w[i]) * 0x100000001b3ULL;
+	return h;
+}
+
+#endif /* __TRACEBIN_H_ */